@@ -1,22 +1,776 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <ctype.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
+#include "cli.h"
 #include "nvs_flash.h"
 #include "esp_system.h"
 #include "wifi_connect.h"
 #include "webserver.h"
 #include "ir_manage.h"
+#include "ir_key.h"
+#include "ir_pool.h"
+#include "ir_cache.h"
+#include "ir_jitter.h"
+#include "ir_verify.h"
+#include "ir_sweep.h"
+#include "ir_backup.h"
+#include "fleet_sync.h"
+#include "scheduler.h"
+#include "mqtt_remote.h"
+#include "rate_limit.h"
+#include "boot.h"
+#include "mem_budget.h"
+#include "record_store.h"
+#include "soak.h"
 #include "pin_config.h"
 
-#define UART_BUFFER_SIZE     2048
+enum {
+    BOOT_STAGE_NVS,
+    BOOT_STAGE_IR,
+    BOOT_STAGE_IR_STORAGE,
+    BOOT_STAGE_IR_SWEEP,
+    BOOT_STAGE_CLI,
+    BOOT_STAGE_WIFI,
+    BOOT_STAGE_SCHEDULER,
+    BOOT_STAGE_FLEET_SYNC,
+    BOOT_STAGE_WEBSERVER,
+    BOOT_STAGE_KEY,
+    BOOT_STAGE_MQTT,
+    BOOT_STAGE_IR_VERIFY,
+};
+
+#define KEY_PRESS_STACK_SIZE        2048
 
 TaskHandle_t key_press_task_handle;
-char uart_buffer[UART_BUFFER_SIZE];
+MEM_TASK_BUFFER(s_key_press_task, KEY_PRESS_STACK_SIZE);
+static ir_backup_import_t *s_cli_import;
+
+static esp_err_t cli_export_write_hex(const uint8_t *data, size_t length, void *ctx)
+{
+    size_t *column = (size_t *) ctx;
+    for (size_t i = 0; i < length; i++) {
+        printf("%02x", data[i]);
+        if (++(*column) == 32) {
+            *column = 0;
+            printf("\n");
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t cli_import_feed_hex(ir_backup_import_t *import, const char *hex)
+{
+    uint8_t chunk[64];
+    size_t length = 0;
+    while (isxdigit((unsigned char) hex[0]) && isxdigit((unsigned char) hex[1]))
+    {
+        char byte_str[3] = {hex[0], hex[1], '\0'};
+        chunk[length++] = strtol(byte_str, NULL, 16);
+        hex += 2;
+        if (length == sizeof(chunk)) {
+            if (ir_backup_import_feed(import, chunk, length) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            length = 0;
+        }
+    }
+    return ir_backup_import_feed(import, chunk, length);
+}
+
+// led on : turn on indicator led
+static esp_err_t cli_led_on(char *args)
+{
+    printf(">Led on\n");
+    return gpio_set_level(LED_PIN, 1);
+}
+
+// led off : turn off indicator led
+static esp_err_t cli_led_off(char *args)
+{
+    printf(">Led off\n");
+    return gpio_set_level(LED_PIN, 0);
+}
+
+// send ir protocol address command : send ir code
+static esp_err_t cli_send_ir(char *args)
+{
+    int ir_send[3];
+    if (str_to_parram_int(args, ir_send, 3) == ESP_FAIL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ir_tx_take() != ESP_OK) {
+        return ESP_ERR_TIMEOUT;
+    }
+    printf(">Sent IR: %d %d %d\n", ir_send[0], ir_send[1], ir_send[2]);
+    irmp_data.address  = (uint16_t) ir_send[1];
+    irmp_data.command  = (uint16_t) ir_send[2];
+    irmp_data.flags    = 0;
+    irmp_data.protocol = (uint8_t) ir_send[0];
+    irsnd_send_data (&irmp_data, TRUE);
+    xSemaphoreGive(ir_mutex);
+    return ESP_OK;
+}
+
+// set wifi ssid+pwd : set wifi
+static esp_err_t cli_set_wifi(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_WIFI), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    char *wifi_new[2];
+    if (str_to_parram_str(args, wifi_new, 2) == ESP_FAIL) {
+        printf(">Format should be: set wifi ssid+pwd.\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(wifi_new[0]) >= MAX_WIFI_SSID_LENGTH || strlen(wifi_new[1]) >= MAX_WIFI_PWD_LENGTH) {
+        printf(">SSID or PWD to long.\n");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    printf(">Set WIFI SSID: %s\n", wifi_new[0]);
+    set_wifi(wifi_new[0], wifi_new[1]);
+    return ESP_OK;
+}
+
+// add tv ir ir_code remote_id : enter add tv ir mode
+static esp_err_t cli_add_tv_ir(char *args)
+{
+    int ir_receive[2];
+    if (str_to_parram_int(args, ir_receive, 2) == ESP_FAIL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    printf(">Add TV IR, please point the TV remote to the receiver and press key.\n");
+    return ir_add_code_tv_detect(ir_receive[0], ir_receive[1]);
+}
+
+// sweep tv remote_id : send candidate power codes, confirm with user key or "sweep confirm"
+static esp_err_t cli_sweep_tv(char *args)
+{
+    int ir_sweep[1];
+    if (str_to_parram_int(args, ir_sweep, 1) == ESP_FAIL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    printf(">Sweep TV, press the user key when the TV turns on or off.\n");
+    return ir_sweep_start_tv(ir_sweep[0]);
+}
+
+// sweep confirm : confirm the TV reacted to the last sweep burst
+static esp_err_t cli_sweep_confirm(char *args)
+{
+    printf(">Sweep confirmed.\n");
+    return ir_sweep_confirm();
+}
+
+// sweep stop : abort running sweep
+static esp_err_t cli_sweep_stop(char *args)
+{
+    printf(">Sweep stopped.\n");
+    return ir_sweep_stop();
+}
+
+// export : dump all remotes as hex encoded backup stream
+static esp_err_t cli_export(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    size_t column = 0;
+    printf(">Export begin\n");
+    esp_err_t err = ir_backup_export(cli_export_write_hex, &column);
+    printf("%s>Export end\n", column ? "\n" : "");
+    return err;
+}
+
+// import begin|end|abort, import data hex : restore a backup stream produced by export
+static esp_err_t cli_import_begin(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    ir_backup_import_abort(s_cli_import);
+    s_cli_import = ir_backup_import_begin();
+    printf(">Import begin\n");
+    return s_cli_import ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t cli_import_data(char *args)
+{
+    if (cli_import_feed_hex(s_cli_import, args) != ESP_OK) {
+        printf(">Import failed.\n");
+        ir_backup_import_abort(s_cli_import);
+        s_cli_import = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t cli_import_end(char *args)
+{
+    esp_err_t err = ir_backup_import_finish(s_cli_import);
+    printf(">Import %s\n", err == ESP_OK ? "done." : "failed.");
+    s_cli_import = NULL;
+    return err;
+}
+
+static esp_err_t cli_import_abort(char *args)
+{
+    ir_backup_import_abort(s_cli_import);
+    s_cli_import = NULL;
+    printf(">Import aborted.\n");
+    return ESP_OK;
+}
+
+// sync primary on|off : push remotes to other units on the LAN
+static esp_err_t cli_sync_primary_on(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_FLEET_SYNC), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    printf(">Sync primary on\n");
+    return fleet_sync_set_primary(1);
+}
+
+static esp_err_t cli_sync_primary_off(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_FLEET_SYNC), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    printf(">Sync primary off\n");
+    return fleet_sync_set_primary(0);
+}
+
+// sync key key : shared key of the fleet, pushes to POST /backup must carry it
+static esp_err_t cli_sync_key(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_FLEET_SYNC), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    char *key[1];
+    if (str_to_parram_str(args, key, 1) == ESP_FAIL || strlen(key[0]) >= FLEET_SYNC_KEY_LEN) {
+        printf(">Format should be: sync key key, at most %d characters.\n", FLEET_SYNC_KEY_LEN - 1);
+        return ESP_ERR_INVALID_ARG;
+    }
+    printf(">Sync key set\n");
+    return fleet_sync_set_key(key[0]);
+}
+
+// sync now : advertise config and push to peers without waiting for the next period
+static esp_err_t cli_sync_now(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_FLEET_SYNC), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    printf(">Sync now\n");
+    return fleet_sync_now();
+}
+
+// schedule add remote_id code_id when [period_s] : when is +seconds, HH:MM or epoch
+static esp_err_t cli_schedule_add(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    uint16_t job_id;
+    esp_err_t err = scheduler_add_job(args, &job_id);
+    if (err == ESP_ERR_INVALID_STATE) {
+        printf(">Time is not synced yet, +seconds and HH:MM need it, give an epoch time or retry later.\n");
+        return err;
+    }
+    if (err != ESP_OK) {
+        printf(">Format should be: schedule add remote_id code_id +seconds|HH:MM|epoch [period_s].\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    printf(">Added job %d\n", job_id);
+    return ESP_OK;
+}
+
+// schedule set job_id remote_id code_id when [period_s] : replace a job
+static esp_err_t cli_schedule_set(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    char *spec;
+    long job_id = strtol(args, &spec, 10);
+    if (spec == args || job_id < 0 || job_id >= SCHEDULER_MAX_JOB) {
+        printf(">Format should be: schedule set job_id remote_id code_id +seconds|HH:MM|epoch [period_s].\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = scheduler_update_job(job_id, spec);
+    printf(">Update job %ld: %s\n", job_id, err == ESP_OK ? "ok" : err == ESP_ERR_INVALID_STATE ? "time is not synced yet" : "failed");
+    return err;
+}
+
+// schedule del job_id : delete a job
+static esp_err_t cli_schedule_del(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    char *end;
+    long job_id = strtol(args, &end, 10);
+    if (end == args || job_id < 0 || job_id >= SCHEDULER_MAX_JOB) {
+        printf(">Format should be: schedule del job_id.\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = scheduler_delete_job(job_id);
+    printf(">Delete job %ld: %s\n", job_id, err == ESP_OK ? "ok" : "failed");
+    return err;
+}
+
+// schedule tz [posix_tz] : print or set the time zone used for HH:MM, e.g. CET-1CEST,M3.5.0,M10.5.0/3
+static esp_err_t cli_schedule_tz(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    char timezone[SCHEDULER_TZ_LEN];
+    if (*args != '\0') {
+        esp_err_t err = scheduler_set_timezone(args);
+        if (err != ESP_OK) {
+            printf(">Time zone not set: %s\n", esp_err_to_name(err));
+            return err;
+        }
+    }
+    scheduler_get_timezone(timezone, sizeof(timezone));
+    printf(">Time zone %s\n", timezone);
+    return ESP_OK;
+}
+
+// schedule list : print all jobs
+static esp_err_t cli_schedule_list(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    scheduler_job_t job;
+    for (int i = 0; i < SCHEDULER_MAX_JOB; i++) {
+        if (scheduler_get_job(i, &job) == ESP_OK) {
+            printf(">Job %d: remote %d code %d next %lld period %lu\n", i, job.ir_remote_id, job.ir_code_id,
+                   (long long) job.next_s, (unsigned long) job.period_s);
+        }
+    }
+    return ESP_OK;
+}
+
+// pool stats : dedup ratio, bytes saved against one IRMP_DATA per key and lookup cost of the code pool
+static esp_err_t cli_pool_stats(char *args)
+{
+    ir_pool_stats_t stats;
+    ir_pool_get_stats(&stats);
+    size_t ref_bytes = IR_TV_NUM_REMOTE * IR_TV_NUM_CODE;
+    size_t flat_bytes = IR_TV_NUM_REMOTE * IR_TV_NUM_CODE * sizeof(IRMP_DATA);
+    printf(">Pool: %d unique codes, %d references, capacity %d\n", stats.num_entry, stats.num_ref, stats.capacity);
+    printf(">Dedup ratio: %d.%02d\n", stats.num_entry ? stats.num_ref / stats.num_entry : 0,
+           stats.num_entry ? stats.num_ref * 100 / stats.num_entry % 100 : 0);
+    printf(">RAM: %d bytes, %d saved\n", (int) (stats.ram_bytes + ref_bytes), (int) flat_bytes - (int) (stats.ram_bytes + ref_bytes));
+    printf(">NVS: %d bytes, %d saved\n", (int) (stats.nvs_bytes + ref_bytes), (int) flat_bytes - (int) (stats.nvs_bytes + ref_bytes));
+    printf(">Lookup: %lu ns by code, %lu ns by reference\n", (unsigned long) stats.find_ns, (unsigned long) stats.get_ns);
+    return ESP_OK;
+}
+
+// cache stats|clear, cache budget bytes : pre-encoded frame cache for repeatedly sent keys
+static esp_err_t cli_cache_stats(char *args)
+{
+    ir_cache_stats_t stats;
+    if (ir_cache_get_stats(&stats) != ESP_OK) {
+        printf(">Frame cache disabled, IRSND_USE_CALLBACK is not set.\n");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint32_t total = stats.hit + stats.miss;
+    printf(">Cache: %d frames, %d/%d bytes, %lu evicted\n", stats.num_entry, (int) stats.used_bytes, (int) stats.budget_bytes,
+           (unsigned long) stats.eviction);
+    printf(">Hit rate: %lu/%lu (%lu%%), encode time saved %llu us\n", (unsigned long) stats.hit, (unsigned long) total,
+           (unsigned long) (total ? stats.hit * 100ULL / total : 0), (unsigned long long) stats.encode_saved_us);
+    return ESP_OK;
+}
+
+static esp_err_t cli_cache_budget(char *args)
+{
+    int budget[1];
+    if (str_to_parram_int(args, budget, 1) == ESP_FAIL || budget[0] < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    printf(">Cache budget %d bytes\n", budget[0]);
+    return ir_cache_set_budget(budget[0]);
+}
+
+static esp_err_t cli_cache_clear(char *args)
+{
+    printf(">Cache cleared.\n");
+    ir_cache_clear();
+    return ESP_OK;
+}
+
+static void cli_print_jitter_hist(const char *name, const ir_jitter_hist_t *hist)
+{
+    printf(">%-5s n %lu mean |err| %lu us min %ld max %ld out of tolerance %lu\n", name, (unsigned long) hist->count,
+           (unsigned long) (hist->count ? hist->sum_abs_us / hist->count : 0), (long) hist->min_us, (long) hist->max_us,
+           (unsigned long) hist->num_out_of_tolerance);
+    printf(">     ");
+    for (int i = 0; i < IR_JITTER_NUM_BIN; i++) {
+        printf(" %lu", (unsigned long) hist->bin[i]);
+    }
+    printf("\n");
+}
+
+// jitter report : histograms of the last jitter run
+static esp_err_t cli_jitter_report(char *args)
+{
+    ir_jitter_report_t report;
+    ir_jitter_get_report(&report);
+    printf(">%d load clients, %lu HTTP requests, %lu frames, %lu overflowed\n", report.num_client,
+           (unsigned long) report.num_request, (unsigned long) report.num_frame, (unsigned long) report.num_overflow);
+    printf(">|error| bins of %d us, tolerance %d%% of nominal\n", IR_JITTER_BIN_US, IR_JITTER_TOLERANCE_PCT);
+    cli_print_jitter_hist("tick", &report.tick);
+    cli_print_jitter_hist("mark", &report.mark);
+    cli_print_jitter_hist("space", &report.space);
+    return ESP_OK;
+}
+
+// jitter run ir_code remote_id count [clients] : send a key count times with HTTP load and compare edges to nominal
+static esp_err_t cli_jitter_run(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_WEBSERVER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    int ir_code_id, ir_remote_id, count, num_client = 0;
+    if (sscanf(args, "%d %d %d %d", &ir_code_id, &ir_remote_id, &count, &num_client) < 3 || ir_code_id < 0 ||
+        ir_code_id >= IR_TV_NUM_CODE || ir_remote_id < 0 || ir_remote_id >= IR_TV_NUM_REMOTE || count <= 0 || num_client < 0) {
+        printf(">Format should be: jitter run ir_code remote_id count [clients].\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ir_jitter_run(ir_remote_id, ir_code_id, count, num_client);
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        printf(">Jitter run needs the IRSND callback, build with IRSND_USE_CALLBACK=1.\n");
+        return err;
+    }
+    if (err != ESP_OK) {
+        printf(">Jitter run failed: %s\n", esp_err_to_name(err));
+        return err;
+    }
+    return cli_jitter_report(NULL);
+}
+
+// soak run hours remote_id [seed] : replay send, page, save, learn and Wi-Fi traffic for virtual hours on a spare remote
+static esp_err_t cli_soak_run(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_WEBSERVER), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    int virtual_h, ir_remote_id;
+    unsigned int seed = 1;
+    if (sscanf(args, "%d %d %u", &virtual_h, &ir_remote_id, &seed) < 2 || virtual_h <= 0 || ir_remote_id < 0 ||
+        ir_remote_id >= IR_TV_NUM_REMOTE) {
+        printf(">Format should be: soak run hours remote_id [seed].\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = soak_start(ir_remote_id, virtual_h, seed);
+    if (err != ESP_OK) {
+        printf(">Soak not started: %s\n", esp_err_to_name(err));
+        return err;
+    }
+    printf(">Soak running for %d virtual hours, seed %u\n", virtual_h, seed);
+    return ESP_OK;
+}
+
+static esp_err_t cli_soak_stop(char *args)
+{
+    soak_stop();
+    printf(">Soak stopping.\n");
+    return ESP_OK;
+}
+
+// soak report|samples : latency percentiles, heap and NVS trends against the budgets, or the raw samples
+static esp_err_t cli_soak_report(char *args)
+{
+    soak_report_t report;
+    soak_get_report(&report);
+    printf(">%s %lu/%lu virtual s in %lu s, seed %lu\n", report.is_running ? "Running" : "Stopped", (unsigned long) report.virtual_s,
+           (unsigned long) report.target_s, (unsigned long) report.real_s, (unsigned long) report.seed);
+    for (int i = 0; i < SOAK_NUM_OP; i++) {
+        soak_op_stats_t *stats = &report.op_stats[i];
+        printf(">%-5s %6lu ok+err %4lu err %4lu skip, p50 %lu p95 %lu p99 %lu max %lu us\n", soak_get_op_name(i),
+               (unsigned long) stats->count, (unsigned long) stats->num_error, (unsigned long) stats->num_skip,
+               (unsigned long) stats->p50_us, (unsigned long) stats->p95_us, (unsigned long) stats->p99_us, (unsigned long) stats->max_us);
+    }
+    printf(">Heap free %lu -> %lu (%ld B/h), largest %lu -> %lu (%ld B/h), min %lu, max frag %d%%\n",
+           (unsigned long) report.first.free_bytes, (unsigned long) report.last.free_bytes, (long) report.heap_per_h,
+           (unsigned long) report.first.largest_block, (unsigned long) report.last.largest_block, (long) report.largest_per_h,
+           (unsigned long) report.last.min_free_bytes, report.max_fragmentation_pct);
+    printf(">NVS entries %lu -> %lu (%ld/h)\n", (unsigned long) report.first.nvs_used_entry, (unsigned long) report.last.nvs_used_entry,
+           (long) report.nvs_entry_per_h);
+    if (report.virtual_s < SOAK_WARMUP_S) {
+        printf(">Trends are checked after %d virtual s\n", SOAK_WARMUP_S);
+    }
+    printf(">%s\n", report.num_reason ? "FAIL" : "PASS");
+    for (int i = 0; i < report.num_reason; i++) {
+        printf(">  %s\n", report.reason_array[i]);
+    }
+    return report.num_reason ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t cli_soak_samples(char *args)
+{
+    soak_sample_t sample;
+    printf(">virtual_s,free,min_free,largest,frag_pct,nvs_entries\n");
+    for (uint16_t i = 0; soak_get_sample(i, &sample) == ESP_OK; i++) {
+        printf(">%lu,%lu,%lu,%lu,%d,%lu\n", (unsigned long) sample.virtual_s, (unsigned long) sample.free_bytes,
+               (unsigned long) sample.min_free_bytes, (unsigned long) sample.largest_block, sample.fragmentation_pct,
+               (unsigned long) sample.nvs_used_entry);
+    }
+    return ESP_OK;
+}
+
+// rate stats : per class admitted, 429 throttled and 503 overloaded web requests
+static esp_err_t cli_rate_stats(char *args)
+{
+    rate_limit_stats_t stats;
+    rate_limit_get_stats(&stats);
+    printf(">%d clients tracked, %lu evicted, IR queue %d/%d, web in flight %d/%d\n", stats.num_client, (unsigned long) stats.eviction,
+           (int) ir_get_tx_queue_depth(), IR_TX_QUEUE_LEN, ir_get_tx_inflight(IR_TX_SOURCE_WEB), IR_TX_WEB_SLOTS);
+    for (int i = 0; i < RATE_LIMIT_NUM_CLASS; i++) {
+        printf(">%-4s admitted %lu throttled %lu overloaded %lu\n", rate_limit_get_class_name(i),
+               (unsigned long) stats.class_stats[i].admitted, (unsigned long) stats.class_stats[i].throttled,
+               (unsigned long) stats.class_stats[i].overloaded);
+    }
+    return ESP_OK;
+}
+
+// mem : stack high-water marks per task, heap free/min/largest block and fragmentation per capability
+static esp_err_t cli_mem(char *args)
+{
+    mem_task_info_t task;
+    mem_heap_info_t heap;
+    printf(">%s allocation\n", MEM_STATIC_ALLOC ? "Static" : "Dynamic");
+    for (int i = 0; mem_get_task(i, &task) == ESP_OK; i++) {
+        if (task.stack_size) {
+            printf(">%-18s stack %5lu min free %5lu%s\n", task.name, (unsigned long) task.stack_size,
+                   (unsigned long) task.stack_free_min, task.is_static ? " static" : "");
+        } else {
+            printf(">%-18s stack     - min free %5lu\n", task.name, (unsigned long) task.stack_free_min);
+        }
+    }
+    for (int i = 0; mem_get_heap(i, &heap) == ESP_OK; i++) {
+        printf(">%-8s total %7u free %7u min %7u largest %7u frag %3d%%\n", heap.name, (unsigned) heap.total_bytes,
+               (unsigned) heap.free_bytes, (unsigned) heap.min_free_bytes, (unsigned) heap.largest_block, heap.fragmentation_pct);
+    }
+    return ESP_OK;
+}
+
+// verify on|off : decode every sent frame with the onboard receiver
+static esp_err_t cli_verify_on(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_IR_VERIFY), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    printf(">Verify on\n");
+    return ir_verify_set_enable(1);
+}
+
+static esp_err_t cli_verify_off(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_IR_VERIFY), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    printf(">Verify off\n");
+    return ir_verify_set_enable(0);
+}
+
+// verify stats|reset : loopback pass/fail counters and send-to-decode latency
+static esp_err_t cli_verify_stats(char *args)
+{
+    ir_verify_stats_t stats;
+    ir_verify_get_stats(&stats);
+    printf(">Verify %s: %lu sent, %lu pass, %lu mismatch, %lu timeout, %lu overrun, %lu cancelled by learn\n",
+           ir_verify_is_enabled() ? "on" : "off", (unsigned long) stats.num_sent, (unsigned long) stats.num_pass,
+           (unsigned long) stats.num_mismatch, (unsigned long) stats.num_timeout, (unsigned long) stats.num_overrun,
+           (unsigned long) stats.num_cancel);
+    printf(">Latency min %lu avg %lu max %lu us\n", (unsigned long) stats.min_latency_us,
+           (unsigned long) (stats.num_pass ? stats.sum_latency_us / stats.num_pass : 0), (unsigned long) stats.max_latency_us);
+    if (stats.num_mismatch) {
+        printf(">Last mismatch: sent %x %x %x, decoded %x %x %x\n", stats.last_sent.protocol, stats.last_sent.address,
+               stats.last_sent.command, stats.last_received.protocol, stats.last_received.address, stats.last_received.command);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t cli_verify_reset(char *args)
+{
+    ir_verify_reset_stats();
+    printf(">Verify stats cleared.\n");
+    return ESP_OK;
+}
+
+// mqtt uri uri, mqtt off : broker to connect to, stored in NVS
+static esp_err_t cli_mqtt_uri(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_MQTT), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    char *uri[1];
+    if (str_to_parram_str(args, uri, 1) == ESP_FAIL || strlen(uri[0]) >= MQTT_URI_LEN) {
+        printf(">Format should be: mqtt uri mqtt://host:port.\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    printf(">MQTT broker %s\n", uri[0]);
+    return mqtt_remote_set_uri(uri[0]);
+}
+
+static esp_err_t cli_mqtt_off(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_MQTT), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    printf(">MQTT off\n");
+    return mqtt_remote_set_uri("");
+}
+
+// mqtt stats : connection, command and batching counters
+static esp_err_t cli_mqtt_stats(char *args)
+{
+    mqtt_remote_stats_t stats;
+    mqtt_remote_get_stats(&stats);
+    printf(">MQTT %s, %s\n", stats.is_enabled ? "enabled" : "disabled", stats.is_connected ? "connected" : "not connected");
+    printf(">Commands %lu, rejected %lu\n", (unsigned long) stats.command, (unsigned long) stats.rejected);
+    printf(">Status %lu in %lu batches, dropped %lu, discovery %lu\n", (unsigned long) stats.status, (unsigned long) stats.batch,
+           (unsigned long) stats.dropped, (unsigned long) stats.discovery);
+    return ESP_OK;
+}
+
+// mqtt discovery : publish the Home Assistant config of every learned key again
+static esp_err_t cli_mqtt_discovery(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_MQTT), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    return mqtt_remote_publish_discovery();
+}
+
+// mqtt bench [count] : round trip latency through the broker
+static esp_err_t cli_mqtt_bench(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_MQTT), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    int count[1] = {100};
+    if (*args != '\0' && str_to_parram_int(args, count, 1) == ESP_FAIL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mqtt_remote_bench_t result;
+    esp_err_t err = mqtt_remote_bench(count[0], &result);
+    if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
+        printf(">Bench failed: %s\n", esp_err_to_name(err));
+        return err;
+    }
+    printf(">Received %d/%d\n", result.received, result.sent);
+    printf(">RTT min %lu avg %lu p50 %lu p95 %lu max %lu us\n", (unsigned long) result.min_us, (unsigned long) result.avg_us,
+           (unsigned long) result.p50_us, (unsigned long) result.p95_us, (unsigned long) result.max_us);
+    return err;
+}
+
+// boot : stage timings of the last boot, * marks the critical path, and NVS record health
+static esp_err_t cli_boot(char *args)
+{
+    boot_stage_info_t info;
+    record_stats_t stats;
+    printf(">Boot done at %lld ms\n", (long long) (boot_get_done_us() / 1000));
+    for (uint8_t i = 0; boot_get_stage(i, &info) == ESP_OK; i++) {
+        printf(">%c %-12s core %d ready %5lld start %5lld end %5lld ms (%lld ms) %s\n", info.is_critical ? '*' : ' ', info.name,
+               (int) info.core, (long long) (info.ready_us / 1000), (long long) (info.start_us / 1000),
+               (long long) (info.end_us / 1000), (long long) ((info.end_us - info.start_us) / 1000),
+               info.err == ESP_OK ? "" : esp_err_to_name(info.err));
+    }
+    record_get_stats(&stats);
+    printf(">Records: %lu read, %lu written, %lu fallback, %lu bad slots, %lu migrated, headers %lu us, payloads %lu us\n",
+           (unsigned long) stats.num_read, (unsigned long) stats.num_write, (unsigned long) stats.num_fallback,
+           (unsigned long) stats.num_bad_slot, (unsigned long) stats.num_migrated, (unsigned long) stats.header_us,
+           (unsigned long) stats.payload_us);
+    return ESP_OK;
+}
+
+// echo on|off : echo received characters back in text mode
+static esp_err_t cli_echo_on(char *args)
+{
+    cli_set_echo(1);
+    return ESP_OK;
+}
+
+static esp_err_t cli_echo_off(char *args)
+{
+    cli_set_echo(0);
+    return ESP_OK;
+}
+
+// framed on|off : switch to the binary framed protocol described in cli.h
+static esp_err_t cli_framed_on(char *args)
+{
+    printf(">Framed on\n");
+    cli_set_framed(1);
+    return ESP_OK;
+}
+
+static esp_err_t cli_framed_off(char *args)
+{
+    cli_set_framed(0);
+    printf(">Framed off\n");
+    return ESP_OK;
+}
+
+// restart : restart device
+static esp_err_t cli_restart(char *args)
+{
+    printf(">Restart device.\n");
+    esp_restart();
+    return ESP_OK;
+}
+
+// reset wifi : enter AP mode
+static esp_err_t cli_reset_wifi(char *args)
+{
+    if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_WIFI), BOOT_WAIT_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    printf(">Reset wifi.\n");
+    reset_wifi();
+    return ESP_OK;
+}
+
+static const cli_command_t s_cli_commands[] = {
+    {"led on", cli_led_on},
+    {"led off", cli_led_off},
+    {"send ir", cli_send_ir},
+    {"set wifi", cli_set_wifi},
+    {"add tv ir", cli_add_tv_ir},
+    {"sweep tv", cli_sweep_tv},
+    {"sweep confirm", cli_sweep_confirm},
+    {"sweep stop", cli_sweep_stop},
+    {"export", cli_export},
+    {"import begin", cli_import_begin},
+    {"import data", cli_import_data},
+    {"import end", cli_import_end},
+    {"import abort", cli_import_abort},
+    {"sync primary on", cli_sync_primary_on},
+    {"sync primary off", cli_sync_primary_off},
+    {"sync now", cli_sync_now},
+    {"sync key", cli_sync_key},
+    {"schedule add", cli_schedule_add},
+    {"schedule set", cli_schedule_set},
+    {"schedule del", cli_schedule_del},
+    {"schedule list", cli_schedule_list},
+    {"schedule tz", cli_schedule_tz},
+    {"pool stats", cli_pool_stats},
+    {"cache stats", cli_cache_stats},
+    {"cache budget", cli_cache_budget},
+    {"cache clear", cli_cache_clear},
+    {"rate stats", cli_rate_stats},
+    {"mem", cli_mem},
+    {"verify on", cli_verify_on},
+    {"verify off", cli_verify_off},
+    {"verify stats", cli_verify_stats},
+    {"verify reset", cli_verify_reset},
+    {"jitter run", cli_jitter_run},
+    {"jitter report", cli_jitter_report},
+    {"soak run", cli_soak_run},
+    {"soak stop", cli_soak_stop},
+    {"soak report", cli_soak_report},
+    {"soak samples", cli_soak_samples},
+    {"mqtt uri", cli_mqtt_uri},
+    {"mqtt off", cli_mqtt_off},
+    {"mqtt stats", cli_mqtt_stats},
+    {"mqtt discovery", cli_mqtt_discovery},
+    {"mqtt bench", cli_mqtt_bench},
+    {"boot", cli_boot},
+    {"echo on", cli_echo_on},
+    {"echo off", cli_echo_off},
+    {"framed on", cli_framed_on},
+    {"framed off", cli_framed_off},
+    {"restart", cli_restart},
+    {"reset wifi", cli_reset_wifi},
+};
 
-void cli_task(void *args);
 void key_press_task(void *args);
 
 static void IRAM_ATTR key_isr_handler(void *args)
@@ -28,30 +782,40 @@ static void IRAM_ATTR key_isr_handler(void *args)
     }
 }
 
-void app_main(void)
-{   
+static esp_err_t boot_nvs_init(void)
+{
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
-    ESP_ERROR_CHECK(ret);
-
-    const uart_port_t uart_num = UART_NUM_0;
-    uart_config_t uart_config = {
-        .baud_rate = 115200,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-    };
-    ESP_ERROR_CHECK(uart_param_config(uart_num, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(uart_num, GPIO_NUM_1, GPIO_NUM_3, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-    ESP_ERROR_CHECK(uart_driver_install(uart_num, UART_BUFFER_SIZE, 0, 0, NULL, 0));
+    return ret;
+}
 
+static esp_err_t boot_ir_init(void)
+{
     gpio_reset_pin(LED_PIN);
     gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
     gpio_set_level(LED_PIN, 1);
+    esp_err_t err = ir_init();
+    if (err != ESP_OK)
+        return err;
+    return ir_key_init();
+}
+
+static esp_err_t boot_cli_init(void)
+{
+    esp_err_t err = cli_register_commands(s_cli_commands, sizeof(s_cli_commands) / sizeof(s_cli_commands[0]));
+    if (err != ESP_OK)
+        return err;
+    return cli_init(UART_NUM_0);
+}
+
+static esp_err_t boot_key_init(void)
+{
+    if (mem_task_create(&key_press_task, "KEY_PRESS_TASK", KEY_PRESS_STACK_SIZE, NULL, 2, &key_press_task_handle, 1,
+                        MEM_TASK_STACK(s_key_press_task), MEM_TASK_TCB(s_key_press_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
 
     gpio_reset_pin(KEY_PIN);
     gpio_set_direction(KEY_PIN, GPIO_MODE_INPUT);
@@ -59,47 +823,30 @@ void app_main(void)
     gpio_set_intr_type(KEY_PIN, GPIO_INTR_NEGEDGE);
 
     gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
-    gpio_isr_handler_add(KEY_PIN, key_isr_handler, (void*) KEY_PIN);
-    gpio_dump_io_configuration(stdout, (1ULL << LED_PIN) | (1ULL << KEY_PIN));
-
-    ESP_ERROR_CHECK(ir_init());
-    ESP_ERROR_CHECK(ir_storage_init());
-    ESP_ERROR_CHECK(wifi_init());
-    ESP_ERROR_CHECK(startwebserver());
-
-    xTaskCreatePinnedToCore(&cli_task, "CLI_TASK", 4096, NULL, 1, NULL, 1);
-    xTaskCreatePinnedToCore(&key_press_task, "KEY_PRESS_TASK", 2048, NULL, 2, &key_press_task_handle, 1);
+    return gpio_isr_handler_add(KEY_PIN, key_isr_handler, (void*) KEY_PIN);
 }
 
-esp_err_t str_to_parram_int(char *input, int *output_array, unsigned int array_length)
-{
-    uint8_t token_count = 0;
-    char *pch = strtok(input, " ");
-    while (pch != NULL && token_count < array_length) {
-        output_array[token_count] = strtol(pch, NULL, 10);
-        pch = strtok(NULL, " ");
-        token_count += 1;    
-    }
-    if (token_count < array_length) {
-        return ESP_FAIL;
-    }
-    return ESP_OK;
-}
+// IR path on core 1 so the serial port can send IR codes while Wi-Fi still starts on core 0. The CLI also comes up
+// when the IR stages failed, so the device can still be inspected over serial
+static const boot_stage_t s_boot_stages[] = {
+    [BOOT_STAGE_NVS]        = {"nvs",        boot_nvs_init,    0, 0},
+    [BOOT_STAGE_IR]         = {"ir",         boot_ir_init,     0, 1},
+    [BOOT_STAGE_IR_STORAGE] = {"ir_storage", ir_storage_init,  BOOT_STAGE_BIT(BOOT_STAGE_NVS) | BOOT_STAGE_BIT(BOOT_STAGE_IR), 1},
+    [BOOT_STAGE_IR_SWEEP]   = {"ir_sweep",   ir_sweep_init,    BOOT_STAGE_BIT(BOOT_STAGE_IR_STORAGE), 1},
+    [BOOT_STAGE_CLI]        = {"cli",        boot_cli_init,    BOOT_STAGE_BIT(BOOT_STAGE_IR_SWEEP), 1, BOOT_STAGE_BIT(BOOT_STAGE_IR_SWEEP)},
+    [BOOT_STAGE_WIFI]       = {"wifi",       wifi_init,        BOOT_STAGE_BIT(BOOT_STAGE_NVS), 0},
+    [BOOT_STAGE_SCHEDULER]  = {"scheduler",  scheduler_init,   BOOT_STAGE_BIT(BOOT_STAGE_WIFI) | BOOT_STAGE_BIT(BOOT_STAGE_IR_STORAGE), 0},
+    [BOOT_STAGE_FLEET_SYNC] = {"fleet_sync", fleet_sync_init,  BOOT_STAGE_BIT(BOOT_STAGE_WIFI) | BOOT_STAGE_BIT(BOOT_STAGE_IR_STORAGE), 0},
+    [BOOT_STAGE_WEBSERVER]  = {"webserver",  startwebserver,   BOOT_STAGE_BIT(BOOT_STAGE_IR_SWEEP) | BOOT_STAGE_BIT(BOOT_STAGE_SCHEDULER) |
+                                                               BOOT_STAGE_BIT(BOOT_STAGE_FLEET_SYNC), 0},
+    [BOOT_STAGE_KEY]        = {"key",        boot_key_init,    BOOT_STAGE_BIT(BOOT_STAGE_IR_SWEEP), 1},
+    [BOOT_STAGE_MQTT]       = {"mqtt",       mqtt_remote_init, BOOT_STAGE_BIT(BOOT_STAGE_IR_SWEEP) | BOOT_STAGE_BIT(BOOT_STAGE_WIFI), 0},
+    [BOOT_STAGE_IR_VERIFY]  = {"ir_verify",  ir_verify_init,   BOOT_STAGE_BIT(BOOT_STAGE_NVS) | BOOT_STAGE_BIT(BOOT_STAGE_IR), 1},
+};
 
-esp_err_t str_to_parram_str(char *input, char **output_array, unsigned int array_length)
-{
-    uint8_t token_count = 0;
-    char *pch = strtok(input, "+");
-    while (pch != NULL && token_count < array_length) {
-        printf("%s\n", pch);
-        output_array[token_count] = pch;
-        pch = strtok(NULL, "+");
-        token_count += 1;
-    }
-    if (token_count < array_length) {
-        return ESP_FAIL;
-    }
-    return ESP_OK;
+void app_main(void)
+{   
+    ESP_ERROR_CHECK(boot_run(s_boot_stages, sizeof(s_boot_stages) / sizeof(s_boot_stages[0])));
 }
 
 void key_press_task(void *args)
@@ -113,88 +860,14 @@ void key_press_task(void *args)
         if ((now_tick - previous_tick) >= (DEBOUNCE_PERIOD_MS / portTICK_PERIOD_MS)) {
             previous_tick = now_tick;
             printf("User key pressed\n");
-            reset_wifi();
-        }
-    }
-}
-
-void cli_task(void *args)
-{
-    int length = 0;
-    while (1)
-    {
-        length = uart_read_bytes(UART_NUM_0, uart_buffer, UART_BUFFER_SIZE - 1, 20 / portTICK_PERIOD_MS);
-        if (length) {
-            uart_buffer[length] = '\0';
-            uart_write_bytes(UART_NUM_0, uart_buffer, length);
-            // led on : turn on indicator led
-            if (strncmp(uart_buffer, "led on", strlen("led on")) == 0) {
-                printf(">Led on\n");
-                gpio_set_level(LED_PIN, 1);
-            }
-            // led off : turn off indicator led
-            else if (strncmp(uart_buffer, "led off", strlen("led off")) == 0) {
-                printf(">Led off\n");
-                gpio_set_level(LED_PIN, 0);
-            }
-            // send ir protocol+address+command : send ir code
-            else if (strncmp(uart_buffer, "send ir ", strlen("send ir ")) == 0) {
-                int ir_send[3];
-                if (str_to_parram_int(uart_buffer + strlen("send ir "), ir_send, 3) == ESP_FAIL) {
-                    continue;
-                }
-                if (xSemaphoreTake(ir_mutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
-                    printf(">Sent IR: %d %d %d\n", ir_send[0], ir_send[1], ir_send[2]);
-                    irmp_data.address  = (uint16_t) ir_send[1];       
-                    irmp_data.command  = (uint16_t) ir_send[2];       
-                    irmp_data.flags    = 0;
-                    irmp_data.protocol = (uint8_t) ir_send[0];
-                    irsnd_send_data (&irmp_data, TRUE);
-                    xSemaphoreGive(ir_mutex);
-                }
-            }
-            // set wifi ssid+pwd : set wifi 
-            else if (strncmp(uart_buffer, "set wifi ", strlen("set wifi ")) == 0) {
-                char *wifi_new[2];
-                if(str_to_parram_str(uart_buffer + strlen("set wifi "), wifi_new, 2) == ESP_FAIL) {
-                    printf(">Format should be: set wifi ssid+pwd.\n");
-                    continue;
-                }
-                char *ptr;
-                ptr = strrchr(wifi_new[1], '\r');
-                if (ptr != NULL) {
-                    *ptr = '\0';
-                }
-                ptr = strrchr(wifi_new[1], '\n');
-                if (ptr != NULL) {
-                    *ptr = '\0';
-                }
-                if (strlen(wifi_new[0]) >= MAX_WIFI_SSID_LENGTH || strlen(wifi_new[1]) >= MAX_WIFI_PWD_LENGTH) {
-                    printf(">SSID or PWD to long.\n");    
-                }
-                else {
-                    printf(">Set WIFI SSID: %s\n", wifi_new[0]);
-                    set_wifi(wifi_new[0], wifi_new[1]);
-                }
-            }
-            // add tv ir ir_code remote_id : enter add tv ir mode
-            else if (strncmp(uart_buffer, "add tv ir ", strlen("add tv ir ")) == 0) {
-                int ir_receive[2];
-                if (str_to_parram_int(uart_buffer + strlen("add tv ir "), ir_receive, 2) == ESP_FAIL) {
-                    continue;
-                }
-                printf(">Add TV IR, please point the TV remote to the receiver and press key.\n");
-                ir_add_code_tv_detect(ir_receive[0], ir_receive[1]);
-            } 
-            // restart : restart device
-            else if (strncmp(uart_buffer, "restart", strlen("restart")) == 0) {
-                printf(">Restart device.\n");
-                esp_restart();
-            }
-            else if (strncmp(uart_buffer, "reset wifi", strlen("reset wifi")) == 0) {
-                printf(">Reset wifi.\n");
+            if (ir_sweep_is_running()) {
+                ir_sweep_confirm();
+            } else if (boot_wait(BOOT_STAGE_BIT(BOOT_STAGE_WIFI), 0) == ESP_OK) {
+                // Only the AP fallback needs the event loop and netif from the wifi stage
                 reset_wifi();
+            } else {
+                printf("Wi-Fi not ready\n");
             }
         }
-    }    
+    }
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include <string.h>
+#include "boot.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mem_budget.h"
+
+static const char *TAG = "BOOT";
+
+typedef struct {
+    const boot_stage_t *stage;
+    int64_t start_us;
+    int64_t end_us;
+    esp_err_t err;
+    uint8_t is_critical;
+} boot_stage_state_t;
+
+static EventGroupHandle_t s_boot_event_group;
+MEM_EVENT_GROUP_BUFFER(s_boot_event_group);
+static boot_stage_state_t s_stage_array[BOOT_MAX_STAGE];
+static uint8_t s_num_stage;
+static int64_t s_boot_start_us;
+static int64_t s_boot_done_us;
+
+// First error among the finished stages in stage_mask
+static esp_err_t boot_get_error(uint32_t stage_mask)
+{
+    for (int i = 0; i < s_num_stage; i++) {
+        if ((stage_mask & BOOT_STAGE_BIT(i)) && s_stage_array[i].err != ESP_OK)
+            return s_stage_array[i].err;
+    }
+    return ESP_OK;
+}
+
+// A failing stage is recorded and still sets its bit, so the rest of the device keeps booting
+static void boot_stage_task(void *args)
+{
+    boot_stage_state_t *state = (boot_stage_state_t *) args;
+    if (state->stage->deps) {
+        xEventGroupWaitBits(s_boot_event_group, state->stage->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    state->start_us = esp_timer_get_time();
+    if (boot_get_error(state->stage->deps & ~state->stage->optional_deps) != ESP_OK) {
+        state->err = ESP_ERR_INVALID_STATE;
+        ESP_LOGE(TAG, "Stage %s skipped, a dependency failed", state->stage->name);
+    } else {
+        state->err = state->stage->init();
+        if (state->err != ESP_OK) {
+            ESP_LOGE(TAG, "Stage %s failed: %s", state->stage->name, esp_err_to_name(state->err));
+        }
+    }
+    state->end_us = esp_timer_get_time();
+    xEventGroupSetBits(s_boot_event_group, BOOT_STAGE_BIT(state - s_stage_array));
+    vTaskDelete(NULL);
+}
+
+// Walk back from the last stage to finish through the dependency that finished last
+static void boot_mark_critical_path(void)
+{
+    int last = -1;
+    for (int i = 0; i < s_num_stage; i++) {
+        if (last < 0 || s_stage_array[i].end_us > s_stage_array[last].end_us) {
+            last = i;
+        }
+    }
+    while (last >= 0)
+    {
+        s_stage_array[last].is_critical = 1;
+        uint32_t deps = s_stage_array[last].stage->deps;
+        last = -1;
+        for (int i = 0; i < s_num_stage; i++) {
+            if ((deps & BOOT_STAGE_BIT(i)) && (last < 0 || s_stage_array[i].end_us > s_stage_array[last].end_us)) {
+                last = i;
+            }
+        }
+    }
+}
+
+esp_err_t boot_run(const boot_stage_t *stages, size_t count)
+{
+    if (count > BOOT_MAX_STAGE)
+        return ESP_ERR_INVALID_SIZE;
+    s_boot_event_group = mem_event_group_create(MEM_EVENT_GROUP(s_boot_event_group));
+    if (s_boot_event_group == NULL)
+        return ESP_ERR_NO_MEM;
+
+    s_boot_start_us = esp_timer_get_time();
+    s_num_stage = count;
+    for (size_t i = 0; i < count; i++) {
+        s_stage_array[i].stage = &stages[i];
+        if (xTaskCreatePinnedToCore(&boot_stage_task, stages[i].name, BOOT_STAGE_STACK_SIZE, &s_stage_array[i],
+                                    BOOT_STAGE_PRIORITY, NULL, stages[i].core) != pdPASS)
+            return ESP_ERR_NO_MEM;
+    }
+
+    xEventGroupWaitBits(s_boot_event_group, BOOT_STAGE_BIT(count) - 1, pdFALSE, pdTRUE, portMAX_DELAY);
+    s_boot_done_us = esp_timer_get_time();
+    boot_mark_critical_path();
+    ESP_LOGI(TAG, "Boot done in %lld ms", (long long) (s_boot_done_us / 1000));
+    if (boot_get_error(BOOT_STAGE_BIT(count) - 1) != ESP_OK) {
+        ESP_LOGW(TAG, "Some stages failed, run boot for details");
+    }
+    return ESP_OK;
+}
+
+esp_err_t boot_wait(uint32_t stage_mask, uint32_t timeout_ms)
+{
+    if (s_boot_event_group == NULL)
+        return ESP_ERR_INVALID_STATE;
+    EventBits_t bits = xEventGroupWaitBits(s_boot_event_group, stage_mask, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    if ((bits & stage_mask) != stage_mask)
+        return ESP_ERR_TIMEOUT;
+    return boot_get_error(stage_mask);
+}
+
+uint8_t boot_is_done(uint32_t stage_mask)
+{
+    if (s_boot_event_group == NULL)
+        return 0;
+    return (xEventGroupGetBits(s_boot_event_group) & stage_mask) == stage_mask && boot_get_error(stage_mask) == ESP_OK;
+}
+
+esp_err_t boot_get_stage(uint8_t index, boot_stage_info_t *info)
+{
+    if (index >= s_num_stage)
+        return ESP_ERR_NOT_FOUND;
+    boot_stage_state_t *state = &s_stage_array[index];
+    info->name = state->stage->name;
+    info->core = state->stage->core;
+    // Ready when the last dependency finished, the gap to start_us is time spent waiting for a core
+    info->ready_us = s_boot_start_us;
+    for (int i = 0; i < s_num_stage; i++) {
+        if ((state->stage->deps & BOOT_STAGE_BIT(i)) && s_stage_array[i].end_us > info->ready_us) {
+            info->ready_us = s_stage_array[i].end_us;
+        }
+    }
+    info->start_us = state->start_us;
+    info->end_us = state->end_us;
+    info->err = state->err;
+    info->is_critical = state->is_critical;
+    return ESP_OK;
+}
+
+int64_t boot_get_done_us(void)
+{
+    return s_boot_done_us;
+}
\ No newline at end of file
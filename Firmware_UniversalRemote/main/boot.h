@@ -0,0 +1,52 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define BOOT_MAX_STAGE              24
+#define BOOT_STAGE_STACK_SIZE       4096
+#define BOOT_STAGE_PRIORITY         3
+#define BOOT_WAIT_TIMEOUT_MS        10000
+
+#define BOOT_STAGE_BIT(stage)       (1UL << (stage))
+
+/*
+ * A stage starts once every stage in deps has finished, stages without a path between them run concurrently.
+ * A failed stage still finishes, its dependents are skipped unless they list it in optional_deps as well.
+ */
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(void);
+    uint32_t deps;
+    BaseType_t core;
+    uint32_t optional_deps;
+} boot_stage_t;
+
+typedef struct {
+    const char *name;
+    BaseType_t core;
+    int64_t ready_us;
+    int64_t start_us;
+    int64_t end_us;
+    esp_err_t err;
+    uint8_t is_critical;
+} boot_stage_info_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t boot_run(const boot_stage_t *stages, size_t count);
+esp_err_t boot_wait(uint32_t stage_mask, uint32_t timeout_ms);
+uint8_t boot_is_done(uint32_t stage_mask);
+esp_err_t boot_get_stage(uint8_t index, boot_stage_info_t *info);
+int64_t boot_get_done_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "cli.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "mem_budget.h"
+
+static const char *TAG = "CLI";
+
+enum {
+    FRAME_STATE_SOF,
+    FRAME_STATE_SEQ,
+    FRAME_STATE_LEN_LOW,
+    FRAME_STATE_LEN_HIGH,
+    FRAME_STATE_PAYLOAD,
+    FRAME_STATE_CRC_LOW,
+    FRAME_STATE_CRC_HIGH,
+};
+
+static uart_port_t s_uart_num;
+static QueueHandle_t s_uart_queue;
+MEM_TASK_BUFFER(s_cli_task, CLI_STACK_SIZE);
+static uint8_t s_is_echo = 1;
+static uint8_t s_is_framed;
+
+// Commands are chained per bucket of the hash of their first word, index + 1 so 0 ends a chain
+static const cli_command_t *s_command_array[CLI_MAX_COMMAND];
+static uint8_t s_command_len_array[CLI_MAX_COMMAND];
+static uint8_t s_command_next_array[CLI_MAX_COMMAND];
+static uint8_t s_bucket_array[CLI_HASH_SIZE];
+static uint8_t s_num_command;
+
+static char s_line[CLI_LINE_SIZE];
+static size_t s_line_len;
+static uint8_t s_is_line_overflow;
+
+static uint8_t s_frame_state;
+static uint8_t s_frame_seq;
+static uint16_t s_frame_len;
+static uint16_t s_frame_crc;
+static uint16_t s_frame_rx_crc;
+static TickType_t s_frame_tick;
+
+static uint32_t cli_hash_word(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str != '\0' && *str != ' ')
+    {
+        hash = (hash ^ (uint8_t) *str++) * 16777619u;
+    }
+    return hash % CLI_HASH_SIZE;
+}
+
+esp_err_t cli_register_commands(const cli_command_t *commands, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (s_num_command >= CLI_MAX_COMMAND) {
+            ESP_LOGE(TAG, "Command table full");
+            return ESP_ERR_NO_MEM;
+        }
+        uint32_t bucket = cli_hash_word(commands[i].command);
+        s_command_array[s_num_command] = &commands[i];
+        s_command_len_array[s_num_command] = strlen(commands[i].command);
+        s_command_next_array[s_num_command] = s_bucket_array[bucket];
+        s_bucket_array[bucket] = ++s_num_command;
+    }
+    return ESP_OK;
+}
+
+esp_err_t cli_execute(char *line)
+{
+    size_t length = strlen(line);
+    // Only line endings, trailing spaces can belong to an argument such as a Wi-Fi password
+    while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == '\n'))
+    {
+        line[--length] = '\0';
+    }
+    if (length == 0)
+        return ESP_OK;
+
+    // Longest registered command that matches whole words, e.g. "sync primary on" before "sync"
+    const cli_command_t *match = NULL;
+    size_t match_len = 0;
+    for (uint8_t i = s_bucket_array[cli_hash_word(line)]; i != 0; i = s_command_next_array[i - 1]) {
+        size_t command_len = s_command_len_array[i - 1];
+        if (command_len > match_len && strncmp(line, s_command_array[i - 1]->command, command_len) == 0 &&
+            (line[command_len] == ' ' || line[command_len] == '\0')) {
+            match = s_command_array[i - 1];
+            match_len = command_len;
+        }
+    }
+    if (match == NULL) {
+        printf(">Unknown command: %s\n", line);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char *args = line + match_len;
+    while (*args == ' ')
+    {
+        args++;
+    }
+    return match->handler(args);
+}
+
+static void cli_send_response(uint8_t seq, uint8_t status)
+{
+    uint8_t frame[6] = {CLI_FRAME_SOF, status == CLI_STATUS_OK ? CLI_FRAME_ACK : CLI_FRAME_NAK, seq, status};
+    uint16_t crc = esp_rom_crc16_le(0, frame + 1, 3);
+    frame[4] = crc & 0xFF;
+    frame[5] = crc >> 8;
+    uart_write_bytes(s_uart_num, frame, sizeof(frame));
+}
+
+static void cli_feed_frame(uint8_t byte)
+{
+    // A partial request that went quiet is dropped, the host resends it with a new SOF
+    TickType_t now_tick = xTaskGetTickCount();
+    if (s_frame_state != FRAME_STATE_SOF && now_tick - s_frame_tick > pdMS_TO_TICKS(CLI_FRAME_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "Frame timeout, resync");
+        s_frame_state = FRAME_STATE_SOF;
+        s_line_len = 0;
+    }
+    s_frame_tick = now_tick;
+
+    if (s_frame_state != FRAME_STATE_SOF && s_frame_state < FRAME_STATE_CRC_LOW) {
+        s_frame_crc = esp_rom_crc16_le(s_frame_crc, &byte, 1);
+    }
+
+    switch (s_frame_state)
+    {
+    case FRAME_STATE_SOF:
+        if (byte == CLI_FRAME_SOF) {
+            s_frame_crc = 0;
+            s_frame_state = FRAME_STATE_SEQ;
+        }
+        break;
+    case FRAME_STATE_SEQ:
+        s_frame_seq = byte;
+        s_frame_state = FRAME_STATE_LEN_LOW;
+        break;
+    case FRAME_STATE_LEN_LOW:
+        s_frame_len = byte;
+        s_frame_state = FRAME_STATE_LEN_HIGH;
+        break;
+    case FRAME_STATE_LEN_HIGH:
+        s_frame_len |= byte << 8;
+        s_line_len = 0;
+        s_frame_state = s_frame_len ? FRAME_STATE_PAYLOAD : FRAME_STATE_CRC_LOW;
+        break;
+    case FRAME_STATE_PAYLOAD:
+        if (s_line_len < CLI_LINE_SIZE - 1) {
+            s_line[s_line_len] = byte;
+        }
+        if (++s_line_len == s_frame_len) {
+            s_frame_state = FRAME_STATE_CRC_LOW;
+        }
+        break;
+    case FRAME_STATE_CRC_LOW:
+        s_frame_rx_crc = byte;
+        s_frame_state = FRAME_STATE_CRC_HIGH;
+        break;
+    case FRAME_STATE_CRC_HIGH:
+        s_frame_rx_crc |= byte << 8;
+        s_frame_state = FRAME_STATE_SOF;
+        if (s_frame_rx_crc != s_frame_crc) {
+            cli_send_response(s_frame_seq, CLI_STATUS_BAD_CRC);
+        } else if (s_frame_len >= CLI_LINE_SIZE) {
+            cli_send_response(s_frame_seq, CLI_STATUS_TOO_LONG);
+        } else {
+            s_line[s_frame_len] = '\0';
+            esp_err_t err = cli_execute(s_line);
+            if (err == ESP_OK) {
+                cli_send_response(s_frame_seq, CLI_STATUS_OK);
+            } else {
+                cli_send_response(s_frame_seq, err == ESP_ERR_NOT_FOUND ? CLI_STATUS_UNKNOWN_COMMAND : CLI_STATUS_COMMAND_FAILED);
+            }
+        }
+        s_line_len = 0;
+        break;
+    }
+}
+
+static void cli_feed_text(uint8_t byte)
+{
+    if (byte == '\r' || byte == '\n') {
+        if (s_is_line_overflow) {
+            printf(">Line too long.\n");
+        } else if (s_line_len > 0) {
+            s_line[s_line_len] = '\0';
+            cli_execute(s_line);
+        }
+        s_line_len = 0;
+        s_is_line_overflow = 0;
+    } else if (s_line_len < CLI_LINE_SIZE - 1) {
+        s_line[s_line_len++] = byte;
+    } else {
+        s_is_line_overflow = 1;
+    }
+}
+
+void cli_task(void *args)
+{
+    uart_event_t event;
+    uint8_t buf[128];
+    while (1)
+    {
+        if (xQueueReceive(s_uart_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        switch (event.type)
+        {
+        case UART_DATA: {
+            size_t remaining = event.size;
+            while (remaining > 0)
+            {
+                int length = uart_read_bytes(s_uart_num, buf, remaining < sizeof(buf) ? remaining : sizeof(buf), 0);
+                if (length <= 0) {
+                    break;
+                }
+                if (s_is_echo && !s_is_framed) {
+                    uart_write_bytes(s_uart_num, buf, length);
+                }
+                for (int i = 0; i < length; i++) {
+                    if (s_is_framed) {
+                        cli_feed_frame(buf[i]);
+                    } else {
+                        cli_feed_text(buf[i]);
+                    }
+                }
+                remaining -= length;
+            }
+            break;
+        }
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            ESP_LOGW(TAG, "UART overflow, input dropped");
+            uart_flush_input(s_uart_num);
+            xQueueReset(s_uart_queue);
+            s_line_len = 0;
+            s_frame_state = FRAME_STATE_SOF;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+esp_err_t cli_init(uart_port_t uart_num)
+{
+    uart_config_t uart_config = {
+        .baud_rate = 115200,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+    };
+    esp_err_t err;
+    s_uart_num = uart_num;
+    err = uart_param_config(uart_num, &uart_config);
+    if (err != ESP_OK) return err;
+    err = uart_set_pin(uart_num, GPIO_NUM_1, GPIO_NUM_3, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (err != ESP_OK) return err;
+    err = uart_driver_install(uart_num, CLI_UART_RX_BUFFER_SIZE, 0, CLI_EVENT_QUEUE_LEN, &s_uart_queue, 0);
+    if (err != ESP_OK) return err;
+
+    if (mem_task_create(&cli_task, "CLI_TASK", CLI_STACK_SIZE, NULL, 1, NULL, 1, MEM_TASK_STACK(s_cli_task), MEM_TASK_TCB(s_cli_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+void cli_set_echo(uint8_t is_echo)
+{
+    s_is_echo = is_echo;
+}
+
+void cli_set_framed(uint8_t is_framed)
+{
+    s_frame_state = FRAME_STATE_SOF;
+    s_line_len = 0;
+    s_is_framed = is_framed;
+}
+
+esp_err_t str_to_parram_int(char *input, int *output_array, unsigned int array_length)
+{
+    uint8_t token_count = 0;
+    char *save_ptr;
+    char *pch = strtok_r(input, " ", &save_ptr);
+    while (pch != NULL && token_count < array_length) {
+        output_array[token_count] = strtol(pch, NULL, 10);
+        pch = strtok_r(NULL, " ", &save_ptr);
+        token_count += 1;
+    }
+    if (token_count < array_length) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t str_to_parram_str(char *input, char **output_array, unsigned int array_length)
+{
+    uint8_t token_count = 0;
+    char *save_ptr;
+    char *pch = strtok_r(input, "+", &save_ptr);
+    while (pch != NULL && token_count < array_length) {
+        output_array[token_count] = pch;
+        pch = strtok_r(NULL, "+", &save_ptr);
+        token_count += 1;
+    }
+    if (token_count < array_length) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/uart.h"
+
+#define CLI_UART_RX_BUFFER_SIZE     1024
+#define CLI_STACK_SIZE              4096
+#define CLI_LINE_SIZE               512
+#define CLI_EVENT_QUEUE_LEN         16
+#define CLI_MAX_COMMAND             64
+#define CLI_HASH_SIZE               32
+#define CLI_FRAME_TIMEOUT_MS        200
+
+/*
+ * Framed mode, all integers little endian:
+ *   request  : CLI_FRAME_SOF | seq u8 | length u16 | command line | crc16 over seq..command line
+ *   response : CLI_FRAME_SOF | CLI_FRAME_ACK or CLI_FRAME_NAK | seq u8 | status u8 | crc16 over ACK/NAK..status
+ * Plain text printed by commands is not escaped and may contain 0xA5, hosts look for a SOF followed by a response
+ * whose crc matches and skip anything else. A request that stalls for CLI_FRAME_TIMEOUT_MS is dropped, so the
+ * parser waits for a new SOF again.
+ */
+#define CLI_FRAME_SOF               0xA5
+#define CLI_FRAME_ACK               0x06
+#define CLI_FRAME_NAK               0x15
+
+enum {
+    CLI_STATUS_OK,
+    CLI_STATUS_BAD_CRC,
+    CLI_STATUS_UNKNOWN_COMMAND,
+    CLI_STATUS_COMMAND_FAILED,
+    CLI_STATUS_TOO_LONG,
+};
+
+typedef esp_err_t (*cli_handler_t)(char *args);
+
+typedef struct {
+    const char *command;
+    cli_handler_t handler;
+} cli_command_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t cli_init(uart_port_t uart_num);
+esp_err_t cli_register_commands(const cli_command_t *commands, size_t count);
+esp_err_t cli_execute(char *line);
+void cli_set_echo(uint8_t is_echo);
+void cli_set_framed(uint8_t is_framed);
+esp_err_t str_to_parram_int(char *input, int *output_array, unsigned int array_length);
+esp_err_t str_to_parram_str(char *input, char **output_array, unsigned int array_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
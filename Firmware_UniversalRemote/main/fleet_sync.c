@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "fleet_sync.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_rom_crc.h"
+#include "esp_http_client.h"
+#include "nvs.h"
+#include "mdns.h"
+#include "ir_manage.h"
+#include "ir_backup.h"
+#include "wifi_connect.h"
+#include "mem_budget.h"
+
+static const char *TAG = "FLEET_SYNC";
+
+static TaskHandle_t s_fleet_sync_task_handle;
+MEM_TASK_BUFFER(s_fleet_sync_task, FLEET_SYNC_STACK_SIZE);
+static nvs_handle_t s_sync_nvs_handle;
+static uint8_t s_is_primary;
+static uint32_t s_advertised_hash;
+static char s_device_id[13];
+static char s_sync_key[FLEET_SYNC_KEY_LEN];
+
+typedef struct {
+    esp_http_client_handle_t client;
+    size_t length;
+} fleet_sync_writer_t;
+
+uint32_t fleet_sync_get_config_hash(void)
+{
+    uint32_t crc = 0;
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        uint32_t hash = ir_get_hash_tv(i);
+        crc = esp_rom_crc32_le(crc, (const uint8_t *) &hash, sizeof(hash));
+    }
+    return crc;
+}
+
+// Manifest format: "<config hash> <remote 1 hash> ... <remote N hash>" in hex
+esp_err_t fleet_sync_get_manifest(char *buf, size_t length)
+{
+    int written = snprintf(buf, length, "%08lx", (unsigned long) fleet_sync_get_config_hash());
+    for (int i = 0; i < IR_TV_NUM_REMOTE && written > 0 && written < length; i++) {
+        written += snprintf(buf + written, length - written, " %08lx", (unsigned long) ir_get_hash_tv(i));
+    }
+    return (written > 0 && written < length) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+static void fleet_sync_update_txt(void)
+{
+    char hash_str[9];
+    uint32_t hash = fleet_sync_get_config_hash();
+    if (hash == s_advertised_hash) {
+        return;
+    }
+    snprintf(hash_str, sizeof(hash_str), "%08lx", (unsigned long) hash);
+    if (mdns_service_txt_item_set("_http", "_tcp", "cfg", hash_str) == ESP_OK) {
+        s_advertised_hash = hash;
+        ESP_LOGI(TAG, "Advertising config %s", hash_str);
+    }
+}
+
+static const char *fleet_sync_get_txt(const mdns_result_t *result, const char *key)
+{
+    for (size_t i = 0; i < result->txt_count; i++) {
+        if (strcmp(result->txt[i].key, key) == 0) {
+            return result->txt[i].value;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t fleet_sync_count_cb(const uint8_t *data, size_t length, void *ctx)
+{
+    ((fleet_sync_writer_t *) ctx)->length += length;
+    return ESP_OK;
+}
+
+static esp_err_t fleet_sync_write_cb(const uint8_t *data, size_t length, void *ctx)
+{
+    fleet_sync_writer_t *writer = (fleet_sync_writer_t *) ctx;
+    if (esp_http_client_write(writer->client, (const char *) data, length) != length)
+        return ESP_FAIL;
+    writer->length += length;
+    return ESP_OK;
+}
+
+static uint8_t fleet_sync_get_delta(esp_http_client_handle_t client)
+{
+    char manifest[FLEET_SYNC_MANIFEST_LEN];
+    uint8_t remote_mask = 0;
+
+    if (esp_http_client_open(client, 0) != ESP_OK)
+        return 0;
+    esp_http_client_fetch_headers(client);
+    int length = esp_http_client_read(client, manifest, sizeof(manifest) - 1);
+    if (esp_http_client_get_status_code(client) != 200 || length <= 0) {
+        esp_http_client_close(client);
+        return 0;
+    }
+    manifest[length] = '\0';
+    esp_http_client_close(client);
+
+    char *pch = manifest;
+    strtoul(pch, &pch, 16);
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        char *end;
+        uint32_t hash = strtoul(pch, &end, 16);
+        if (end == pch || hash != ir_get_hash_tv(i)) {
+            remote_mask |= 1 << i;
+        }
+        pch = end;
+    }
+    return remote_mask;
+}
+
+// Only remotes whose hash differs from the peer manifest are pushed, as a partial backup stream
+static esp_err_t fleet_sync_peer(const char *host, uint16_t port)
+{
+    char url[64];
+    esp_err_t err = ESP_FAIL;
+    snprintf(url, sizeof(url), "http://%s:%d/sync/manifest", host, port);
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = 3000,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL)
+        return ESP_ERR_NO_MEM;
+
+    uint8_t remote_mask = fleet_sync_get_delta(client);
+    if (remote_mask != 0 && s_sync_key[0] == '\0') {
+        ESP_LOGW(TAG, "No sync key set, not pushing to %s", host);
+        remote_mask = 0;
+    }
+    if (remote_mask == 0) {
+        esp_http_client_cleanup(client);
+        return ESP_OK;
+    }
+
+    fleet_sync_writer_t writer = {
+        .client = client,
+        .length = 0,
+    };
+    ir_backup_export_tv(remote_mask, fleet_sync_count_cb, &writer);
+    size_t length = writer.length;
+    writer.length = 0;
+
+    snprintf(url, sizeof(url), "http://%s:%d/backup", host, port);
+    esp_http_client_set_url(client, url);
+    esp_http_client_set_method(client, HTTP_METHOD_POST);
+    esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
+    esp_http_client_set_header(client, FLEET_SYNC_KEY_HEADER, s_sync_key);
+    if (esp_http_client_open(client, length) == ESP_OK) {
+        if (ir_backup_export_tv(remote_mask, fleet_sync_write_cb, &writer) == ESP_OK && writer.length == length) {
+            esp_http_client_fetch_headers(client);
+            if (esp_http_client_get_status_code(client) == 200) {
+                ESP_LOGI(TAG, "Pushed remotes 0x%02x (%d bytes) to %s", remote_mask, (int) length, host);
+                err = ESP_OK;
+            }
+        }
+        esp_http_client_close(client);
+    }
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+static void fleet_sync_peers(void)
+{
+    mdns_result_t *results = NULL;
+    char hash_str[9];
+
+    if (mdns_query_ptr("_http", "_tcp", FLEET_SYNC_QUERY_MS, FLEET_SYNC_MAX_PEER, &results) != ESP_OK)
+        return;
+    snprintf(hash_str, sizeof(hash_str), "%08lx", (unsigned long) fleet_sync_get_config_hash());
+
+    for (mdns_result_t *result = results; result != NULL; result = result->next) {
+        const char *id = fleet_sync_get_txt(result, "id");
+        const char *hash = fleet_sync_get_txt(result, "cfg");
+        if (id == NULL || strcmp(id, s_device_id) == 0) {
+            continue;
+        }
+        if (hash != NULL && strcmp(hash, hash_str) == 0) {
+            continue;
+        }
+        for (mdns_ip_addr_t *addr = result->addr; addr != NULL; addr = addr->next) {
+            if (addr->addr.type == ESP_IPADDR_TYPE_V4) {
+                char host[16];
+                snprintf(host, sizeof(host), IPSTR, IP2STR(&addr->addr.u_addr.ip4));
+                if (fleet_sync_peer(host, result->port) != ESP_OK) {
+                    ESP_LOGW(TAG, "Sync with %s failed", host);
+                }
+                break;
+            }
+        }
+    }
+    mdns_query_results_free(results);
+}
+
+void fleet_sync_task(void *args)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, FLEET_SYNC_PERIOD_MS / portTICK_PERIOD_MS);
+        if (get_wifi_mode() != WIFI_MODE_STA) {
+            continue;
+        }
+        fleet_sync_update_txt();
+        if (s_is_primary) {
+            fleet_sync_peers();
+        }
+    }
+}
+
+esp_err_t fleet_sync_init(void)
+{
+    uint8_t mac[6];
+    esp_err_t err;
+
+    err = nvs_open(SYNC_NAMESPACE, NVS_READWRITE, &s_sync_nvs_handle);
+    if (err != ESP_OK) return err;
+    err = nvs_get_u8(s_sync_nvs_handle, SYNC_PRIMARY_KEY, &s_is_primary);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
+    size_t length = sizeof(s_sync_key);
+    err = nvs_get_str(s_sync_nvs_handle, SYNC_KEY_KEY, s_sync_key, &length);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
+
+    err = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if (err != ESP_OK) return err;
+    snprintf(s_device_id, sizeof(s_device_id), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    err = mdns_service_txt_item_set("_http", "_tcp", "id", s_device_id);
+    if (err != ESP_OK) return err;
+    err = mdns_service_txt_item_set("_http", "_tcp", "role", s_is_primary ? "primary" : "secondary");
+    if (err != ESP_OK) return err;
+    fleet_sync_update_txt();
+
+    // Lowest priority on the core without the IR tasks, sync work only runs when nothing else needs the CPU
+    if (mem_task_create(&fleet_sync_task, "FLEET_SYNC_TASK", FLEET_SYNC_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, &s_fleet_sync_task_handle, 0,
+                        MEM_TASK_STACK(s_fleet_sync_task), MEM_TASK_TCB(s_fleet_sync_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+esp_err_t fleet_sync_set_primary(uint8_t is_primary)
+{
+    esp_err_t err = nvs_set_u8(s_sync_nvs_handle, SYNC_PRIMARY_KEY, is_primary);
+    if (err != ESP_OK) return err;
+    err = nvs_commit(s_sync_nvs_handle);
+    if (err != ESP_OK) return err;
+    s_is_primary = is_primary;
+    mdns_service_txt_item_set("_http", "_tcp", "role", is_primary ? "primary" : "secondary");
+    return ESP_OK;
+}
+
+// An empty key refuses every push and stops this unit from pushing
+esp_err_t fleet_sync_set_key(const char *key)
+{
+    if (strlen(key) >= sizeof(s_sync_key))
+        return ESP_ERR_INVALID_ARG;
+    esp_err_t err = nvs_set_str(s_sync_nvs_handle, SYNC_KEY_KEY, key);
+    if (err != ESP_OK) return err;
+    err = nvs_commit(s_sync_nvs_handle);
+    if (err != ESP_OK) return err;
+    strcpy(s_sync_key, key);
+    return ESP_OK;
+}
+
+// Compares every byte so the time taken does not tell how much of the key matched
+uint8_t fleet_sync_is_authorized(const char *key)
+{
+    size_t length = strlen(s_sync_key);
+    if (length == 0 || strlen(key) != length)
+        return 0;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < length; i++) {
+        diff |= s_sync_key[i] ^ key[i];
+    }
+    return diff == 0;
+}
+
+esp_err_t fleet_sync_now(void)
+{
+    xTaskNotifyGive(s_fleet_sync_task_handle);
+    return ESP_OK;
+}
\ No newline at end of file
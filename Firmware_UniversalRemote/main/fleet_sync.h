@@ -0,0 +1,37 @@
+#ifndef FLEET_SYNC_H
+#define FLEET_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define SYNC_NAMESPACE              "sync_storage"
+#define SYNC_PRIMARY_KEY            "sync_primary"
+#define SYNC_KEY_KEY                "sync_key"
+
+#define FLEET_SYNC_PERIOD_MS        30000
+#define FLEET_SYNC_QUERY_MS         3000
+#define FLEET_SYNC_MAX_PEER         8
+#define FLEET_SYNC_MANIFEST_LEN     64
+#define FLEET_SYNC_STACK_SIZE       4096
+// Shared key every unit of the fleet is given, pushes to POST /backup carry it in this header
+#define FLEET_SYNC_KEY_HEADER       "X-Sync-Key"
+#define FLEET_SYNC_KEY_LEN          65
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t fleet_sync_init(void);
+esp_err_t fleet_sync_set_primary(uint8_t is_primary);
+esp_err_t fleet_sync_now(void);
+esp_err_t fleet_sync_set_key(const char *key);
+uint8_t fleet_sync_is_authorized(const char *key);
+uint32_t fleet_sync_get_config_hash(void);
+esp_err_t fleet_sync_get_manifest(char *buf, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include <string.h>
+#include <stdlib.h>
+#include "ir_backup.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "scheduler.h"
+
+static const char *TAG = "IR_BACKUP";
+
+#define IR_BACKUP_BUFFER_LEN        (IR_BACKUP_MAX_PAYLOAD_LEN > IR_INFO_LEN ? IR_BACKUP_MAX_PAYLOAD_LEN : IR_INFO_LEN)
+#define IR_BACKUP_SCHEDULE_LEN      (SCHEDULER_MAX_JOB * SCHEDULER_JOB_RECORD_LEN)
+
+enum {
+    IMPORT_STATE_HEADER,
+    IMPORT_STATE_RECORD_HEADER,
+    IMPORT_STATE_PAYLOAD,
+    IMPORT_STATE_SKIP,
+    IMPORT_STATE_TRAILER,
+    IMPORT_STATE_DONE,
+    IMPORT_STATE_ERROR,
+};
+
+struct ir_backup_import {
+    uint8_t state;
+    uint8_t version;
+    uint8_t record_type;
+    uint8_t record_id;
+    uint16_t record_count;
+    uint16_t record_done;
+    size_t expected;
+    size_t buf_len;
+    uint32_t crc;
+    uint8_t remote_code_mask;
+    uint8_t remote_info_mask;
+    uint8_t has_schedule;
+    size_t schedule_len;
+    uint8_t buf[IR_BACKUP_BUFFER_LEN];
+    uint8_t schedule[IR_BACKUP_SCHEDULE_LEN];
+    IRMP_DATA code[IR_TV_NUM_REMOTE][IR_TV_NUM_CODE];
+    char info[IR_TV_NUM_REMOTE][IR_INFO_LEN];
+};
+
+typedef struct {
+    ir_backup_write_cb_t write_cb;
+    void *ctx;
+    uint32_t crc;
+} ir_backup_writer_t;
+
+static void put_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static uint16_t get_u16(const uint8_t *in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+static esp_err_t ir_backup_write(ir_backup_writer_t *writer, const uint8_t *data, size_t length)
+{
+    writer->crc = esp_rom_crc32_le(writer->crc, data, length);
+    return writer->write_cb(data, length, writer->ctx);
+}
+
+static esp_err_t ir_backup_write_record(ir_backup_writer_t *writer, uint8_t type, uint8_t id, const uint8_t *payload, uint16_t length)
+{
+    uint8_t header[IR_BACKUP_RECORD_HEADER_LEN] = {type, id};
+    put_u16(header + 2, length);
+    if (ir_backup_write(writer, header, sizeof(header)) != ESP_OK)
+        return ESP_FAIL;
+    if (length && ir_backup_write(writer, payload, length) != ESP_OK)
+        return ESP_FAIL;
+    return ESP_OK;
+}
+
+static uint8_t *ir_backup_snapshot_schedule(size_t *length)
+{
+    uint8_t *schedule = malloc(IR_BACKUP_SCHEDULE_LEN);
+    *length = 0;
+    if (schedule == NULL)
+        return NULL;
+    for (int i = 0; i < SCHEDULER_MAX_JOB; i++) {
+        if (scheduler_encode_job(i, schedule + *length) == ESP_OK) {
+            *length += SCHEDULER_JOB_RECORD_LEN;
+        }
+    }
+    return schedule;
+}
+
+static esp_err_t ir_backup_export_stream(uint8_t remote_mask, uint8_t with_schedule, ir_backup_write_cb_t write_cb, void *ctx)
+{
+    ir_backup_writer_t writer = {
+        .write_cb = write_cb,
+        .ctx = ctx,
+        .crc = 0,
+    };
+    uint16_t record_count = with_schedule ? 1 : 0;
+    uint8_t payload[IR_BACKUP_BUFFER_LEN];
+    // Streams without a schedule are the same in both versions, so fleet pushes stay readable by version 1 peers
+    uint8_t header[IR_BACKUP_HEADER_LEN] = {'I', 'R', 'B', 'K', with_schedule ? IR_BACKUP_VERSION : 1, 0};
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        if (remote_mask & (1 << i)) {
+            record_count += 2;
+        }
+    }
+    put_u16(header + 6, record_count);
+    if (ir_backup_write(&writer, header, sizeof(header)) != ESP_OK)
+        return ESP_FAIL;
+
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        if (!(remote_mask & (1 << i))) {
+            continue;
+        }
+        IRMP_DATA ir_code;
+        for (int j = 0; j < IR_TV_NUM_CODE; j++) {
+            uint8_t *out = payload + j * IR_BACKUP_CODE_LEN;
+            ir_get_code_tv(j, i, &ir_code);
+            out[0] = ir_code.protocol;
+            put_u16(out + 1, ir_code.address);
+            put_u16(out + 3, ir_code.command);
+            out[5] = ir_code.flags;
+        }
+        if (ir_backup_write_record(&writer, IR_BACKUP_RECORD_TV_CODE, i, payload, IR_BACKUP_MAX_PAYLOAD_LEN) != ESP_OK)
+            return ESP_FAIL;
+
+        const char *info = ir_get_code_info_tv(i);
+        if (ir_backup_write_record(&writer, IR_BACKUP_RECORD_TV_INFO, i, (const uint8_t *) info, strnlen(info, IR_INFO_LEN - 1)) != ESP_OK)
+            return ESP_FAIL;
+    }
+
+    if (with_schedule) {
+        size_t schedule_len;
+        uint8_t *schedule = ir_backup_snapshot_schedule(&schedule_len);
+        if (schedule == NULL)
+            return ESP_ERR_NO_MEM;
+        esp_err_t err = ir_backup_write_record(&writer, IR_BACKUP_RECORD_SCHEDULE, 0, schedule, schedule_len);
+        free(schedule);
+        if (err != ESP_OK)
+            return ESP_FAIL;
+    }
+
+    uint8_t trailer[4];
+    put_u16(trailer, writer.crc & 0xFFFF);
+    put_u16(trailer + 2, writer.crc >> 16);
+    return write_cb(trailer, sizeof(trailer), ctx);
+}
+
+esp_err_t ir_backup_export(ir_backup_write_cb_t write_cb, void *ctx)
+{
+    return ir_backup_export_stream((1 << IR_TV_NUM_REMOTE) - 1, 1, write_cb, ctx);
+}
+
+esp_err_t ir_backup_export_tv(uint8_t remote_mask, ir_backup_write_cb_t write_cb, void *ctx)
+{
+    return ir_backup_export_stream(remote_mask, 0, write_cb, ctx);
+}
+
+ir_backup_import_t *ir_backup_import_begin(void)
+{
+    ir_backup_import_t *import = calloc(1, sizeof(ir_backup_import_t));
+    if (import == NULL) {
+        ESP_LOGE(TAG, "No memory for import");
+        return NULL;
+    }
+    import->state = IMPORT_STATE_HEADER;
+    import->expected = IR_BACKUP_HEADER_LEN;
+    return import;
+}
+
+static void ir_backup_next_record(ir_backup_import_t *import)
+{
+    import->buf_len = 0;
+    if (import->record_done == import->record_count) {
+        import->state = IMPORT_STATE_TRAILER;
+        import->expected = 4;
+    } else {
+        import->state = IMPORT_STATE_RECORD_HEADER;
+        import->expected = IR_BACKUP_RECORD_HEADER_LEN;
+    }
+}
+
+static esp_err_t ir_backup_parse_record(ir_backup_import_t *import)
+{
+    uint8_t id = import->record_id;
+    switch (import->record_type)
+    {
+    case IR_BACKUP_RECORD_TV_CODE:
+        for (int j = 0; j < IR_TV_NUM_CODE; j++) {
+            const uint8_t *in = import->buf + j * IR_BACKUP_CODE_LEN;
+            import->code[id][j].protocol = in[0];
+            import->code[id][j].address = get_u16(in + 1);
+            import->code[id][j].command = get_u16(in + 3);
+            import->code[id][j].flags = in[5];
+        }
+        import->remote_code_mask |= 1 << id;
+        break;
+    case IR_BACKUP_RECORD_TV_INFO:
+        memcpy(import->info[id], import->buf, import->buf_len);
+        import->info[id][import->buf_len] = '\0';
+        import->remote_info_mask |= 1 << id;
+        break;
+    case IR_BACKUP_RECORD_SCHEDULE:
+        import->schedule_len = import->buf_len;
+        import->has_schedule = 1;
+        break;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ir_backup_process(ir_backup_import_t *import)
+{
+    const uint8_t *buf = import->buf;
+    switch (import->state)
+    {
+    case IMPORT_STATE_HEADER:
+        if (memcmp(buf, IR_BACKUP_MAGIC, 4) != 0) {
+            ESP_LOGE(TAG, "Invalid backup magic");
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (buf[4] > IR_BACKUP_VERSION) {
+            ESP_LOGE(TAG, "Unsupported backup version %d", buf[4]);
+            return ESP_ERR_INVALID_VERSION;
+        }
+        import->version = buf[4];
+        import->record_count = get_u16(buf + 6);
+        ir_backup_next_record(import);
+        break;
+    case IMPORT_STATE_RECORD_HEADER:
+        import->record_type = buf[0];
+        import->record_id = buf[1];
+        import->expected = get_u16(buf + 2);
+        import->buf_len = 0;
+        import->state = IMPORT_STATE_PAYLOAD;
+        if (import->record_type == IR_BACKUP_RECORD_TV_CODE || import->record_type == IR_BACKUP_RECORD_TV_INFO) {
+            if (import->record_id >= IR_TV_NUM_REMOTE) {
+                ESP_LOGE(TAG, "Invalid remote id %d", import->record_id);
+                return ESP_ERR_INVALID_ARG;
+            }
+            if ((import->record_type == IR_BACKUP_RECORD_TV_CODE && import->expected != IR_BACKUP_MAX_PAYLOAD_LEN) ||
+                (import->record_type == IR_BACKUP_RECORD_TV_INFO && import->expected >= IR_INFO_LEN)) {
+                ESP_LOGE(TAG, "Invalid record length %d", (int) import->expected);
+                return ESP_ERR_INVALID_SIZE;
+            }
+        } else if (import->record_type == IR_BACKUP_RECORD_SCHEDULE) {
+            size_t job_record_len = import->version == 1 ? SCHEDULER_JOB_RECORD_LEN_V1 : SCHEDULER_JOB_RECORD_LEN;
+            if (import->expected > IR_BACKUP_SCHEDULE_LEN || import->expected % job_record_len != 0) {
+                ESP_LOGE(TAG, "Invalid schedule length %d", (int) import->expected);
+                return ESP_ERR_INVALID_SIZE;
+            }
+        } else {
+            ESP_LOGW(TAG, "Skipping unknown record type %d", import->record_type);
+            import->state = IMPORT_STATE_SKIP;
+        }
+        if (import->expected == 0) {
+            return ir_backup_process(import);
+        }
+        break;
+    case IMPORT_STATE_PAYLOAD:
+    case IMPORT_STATE_SKIP:
+        if (import->state == IMPORT_STATE_PAYLOAD) {
+            ir_backup_parse_record(import);
+        }
+        import->record_done++;
+        ir_backup_next_record(import);
+        break;
+    case IMPORT_STATE_TRAILER:
+        if ((get_u16(buf) | ((uint32_t) get_u16(buf + 2) << 16)) != import->crc) {
+            ESP_LOGE(TAG, "Backup CRC mismatch");
+            return ESP_ERR_INVALID_CRC;
+        }
+        import->state = IMPORT_STATE_DONE;
+        break;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ir_backup_import_feed(ir_backup_import_t *import, const uint8_t *data, size_t length)
+{
+    if (import == NULL || import->state == IMPORT_STATE_ERROR)
+        return ESP_ERR_INVALID_STATE;
+
+    while (length > 0)
+    {
+        if (import->state == IMPORT_STATE_DONE) {
+            ESP_LOGE(TAG, "Trailing data after backup");
+            import->state = IMPORT_STATE_ERROR;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        size_t take = import->expected - import->buf_len;
+        if (take > length) {
+            take = length;
+        }
+        if (import->state != IMPORT_STATE_TRAILER) {
+            import->crc = esp_rom_crc32_le(import->crc, data, take);
+        }
+        if (import->state == IMPORT_STATE_PAYLOAD && import->record_type == IR_BACKUP_RECORD_SCHEDULE) {
+            memcpy(import->schedule + import->buf_len, data, take);
+        } else if (import->state != IMPORT_STATE_SKIP) {
+            memcpy(import->buf + import->buf_len, data, take);
+        }
+        import->buf_len += take;
+        data += take;
+        length -= take;
+        if (import->buf_len == import->expected) {
+            esp_err_t err = ir_backup_process(import);
+            if (err != ESP_OK) {
+                import->state = IMPORT_STATE_ERROR;
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+// RAM state of the remotes an import replaces, put back when the import cannot be stored
+typedef struct {
+    IRMP_DATA code[IR_TV_NUM_REMOTE][IR_TV_NUM_CODE];
+    char info[IR_TV_NUM_REMOTE][IR_INFO_LEN];
+} ir_backup_previous_t;
+
+static esp_err_t ir_backup_apply(uint8_t code_mask, uint8_t info_mask, IRMP_DATA code[][IR_TV_NUM_CODE], char info[][IR_INFO_LEN])
+{
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        if (code_mask & (1 << i)) {
+            for (int j = 0; j < IR_TV_NUM_CODE; j++) {
+                if (ir_add_code_tv(code[i][j], j, i) != ESP_OK) {
+                    err = ESP_ERR_NO_MEM;
+                }
+            }
+        }
+        if (info_mask & (1 << i)) {
+            ir_add_code_info_tv(info[i], i);
+        }
+    }
+    return err;
+}
+
+// Nothing is written before the whole stream has been received and its CRC checked. The remotes are then
+// applied in RAM and committed, and the schedule is loaded last. When any step fails the remotes and the
+// schedule are put back as they were and recommitted, and the error is returned.
+esp_err_t ir_backup_import_finish(ir_backup_import_t *import)
+{
+    if (import == NULL)
+        return ESP_ERR_INVALID_STATE;
+    if (import->state != IMPORT_STATE_DONE) {
+        ESP_LOGE(TAG, "Incomplete backup stream");
+        free(import);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t previous_schedule_len = 0;
+    uint8_t *previous_schedule = import->has_schedule ? ir_backup_snapshot_schedule(&previous_schedule_len) : NULL;
+    ir_backup_previous_t *previous = malloc(sizeof(ir_backup_previous_t));
+    if (previous == NULL || (import->has_schedule && previous_schedule == NULL)) {
+        free(previous);
+        free(previous_schedule);
+        free(import);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        for (int j = 0; j < IR_TV_NUM_CODE; j++) {
+            ir_get_code_tv(j, i, &previous->code[i][j]);
+        }
+        strncpy(previous->info[i], ir_get_code_info_tv(i), IR_INFO_LEN - 1);
+        previous->info[i][IR_INFO_LEN - 1] = '\0';
+    }
+
+    uint8_t is_schedule_loaded = 0;
+    esp_err_t err = ir_backup_apply(import->remote_code_mask, import->remote_info_mask, import->code, import->info);
+    if (err == ESP_OK) {
+        err = ir_commit_all_tv();
+    }
+    if (err == ESP_OK && import->has_schedule) {
+        is_schedule_loaded = 1;
+        err = scheduler_load(import->schedule, import->schedule_len, import->version == 1 ? 1 : SCHEDULER_RECORD_VERSION);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to import backup: %s, restoring the previous state", esp_err_to_name(err));
+        if (ir_backup_apply(import->remote_code_mask, import->remote_info_mask, previous->code, previous->info) != ESP_OK ||
+            ir_commit_all_tv() != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to restore the remotes");
+        }
+        if (is_schedule_loaded && scheduler_load(previous_schedule, previous_schedule_len, SCHEDULER_RECORD_VERSION) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to restore the schedule");
+        }
+    } else {
+        ESP_LOGI(TAG, "Backup imported");
+    }
+    free(previous);
+    free(previous_schedule);
+    free(import);
+    return err;
+}
+
+void ir_backup_import_abort(ir_backup_import_t *import)
+{
+    free(import);
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef IR_BACKUP_H
+#define IR_BACKUP_H
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ir_manage.h"
+
+/*
+ * Backup stream layout, all integers little endian:
+ *   header  : "IRBK" | version u8 | reserved u8 | record count u16
+ *   record  : type u8 | id u8 | payload length u16 | payload
+ *   trailer : crc32 u32 over header and records
+ * Records of unknown type are skipped on import so newer streams stay readable.
+ */
+#define IR_BACKUP_MAGIC             "IRBK"
+// Version 2 streams carry the job id in each schedule entry, version 1 schedules are loaded as job record version 1
+#define IR_BACKUP_VERSION           2
+#define IR_BACKUP_HEADER_LEN        8
+#define IR_BACKUP_RECORD_HEADER_LEN 4
+#define IR_BACKUP_CODE_LEN          6
+#define IR_BACKUP_MAX_PAYLOAD_LEN   (IR_TV_NUM_CODE * IR_BACKUP_CODE_LEN)
+
+enum {
+    IR_BACKUP_RECORD_TV_CODE = 1,
+    IR_BACKUP_RECORD_TV_INFO,
+    IR_BACKUP_RECORD_SCHEDULE,
+};
+
+typedef esp_err_t (*ir_backup_write_cb_t)(const uint8_t *data, size_t length, void *ctx);
+
+typedef struct ir_backup_import ir_backup_import_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ir_backup_export(ir_backup_write_cb_t write_cb, void *ctx);
+esp_err_t ir_backup_export_tv(uint8_t remote_mask, ir_backup_write_cb_t write_cb, void *ctx);
+ir_backup_import_t *ir_backup_import_begin(void);
+esp_err_t ir_backup_import_feed(ir_backup_import_t *import, const uint8_t *data, size_t length);
+esp_err_t ir_backup_import_finish(ir_backup_import_t *import);
+void ir_backup_import_abort(ir_backup_import_t *import);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,466 @@
+#include <string.h>
+#include <stdlib.h>
+#include "ir_cache.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#if IR_CACHE_ENABLE
+
+#include "driver/rmt_tx.h"
+#include "driver/gpio.h"
+#include "esp_rom_gpio.h"
+#include "soc/gpio_struct.h"
+#include "pin_config.h"
+#include "mem_budget.h"
+
+static const char *TAG = "IR_CACHE";
+
+#define IR_CACHE_MAX_DURATION_US    32767
+
+typedef struct ir_cache_entry {
+    struct ir_cache_entry *prev;
+    struct ir_cache_entry *next;
+    IRMP_DATA code;
+    uint32_t carrier_hz;
+    uint32_t encode_us;
+    uint16_t num_symbol;
+    rmt_symbol_word_t symbol[];
+} ir_cache_entry_t;
+
+// Most recently used entry at the head
+static ir_cache_entry_t *s_cache_head;
+static ir_cache_entry_t *s_cache_tail;
+static SemaphoreHandle_t s_cache_mutex;
+MEM_SEMAPHORE_BUFFER(s_cache_mutex);
+static rmt_encoder_handle_t s_copy_encoder;
+// One channel for the lifetime of the cache. The pin is shared with IRSND and only routed to RMT while a frame
+// is sent, s_tx_entry is the entry the channel is reading until the frame is done
+static rmt_channel_handle_t s_tx_channel;
+static uint32_t s_tx_carrier_hz;
+static uint32_t s_irsnd_signal;
+static uint32_t s_rmt_signal;
+static ir_cache_entry_t *s_tx_entry;
+static ir_cache_stats_t s_cache_stats = {.budget_bytes = IR_CACHE_BUDGET_BYTES};
+
+// Capture state, written from the IR timer callback while a frame is being encoded by IRSND. The callback ends the
+// capture when IRSND goes idle, s_capture_is_pending stays set until the sender that began it has stored it
+static volatile uint8_t s_is_capturing;
+static volatile uint8_t s_capture_is_busy;
+static volatile uint8_t s_capture_is_pending;
+static volatile uint8_t s_capture_is_overflow;
+static volatile uint8_t s_capture_level;
+static volatile uint16_t s_capture_num_duration;
+static volatile uint32_t s_capture_tick;
+static volatile uint32_t s_capture_edge_tick;
+static volatile uint32_t s_capture_isr_us;
+static uint16_t s_capture_duration_array[IR_CACHE_MAX_EDGE];
+static IRMP_DATA s_capture_code;
+
+static uint8_t ir_cache_is_same_code(const IRMP_DATA *a, const IRMP_DATA *b)
+{
+    return a->protocol == b->protocol && a->address == b->address && a->command == b->command && a->flags == b->flags;
+}
+
+static uint32_t ir_cache_carrier_hz(uint8_t protocol)
+{
+    switch (protocol)
+    {
+    case IRMP_RC5_PROTOCOL:
+    case IRMP_RC6_PROTOCOL:
+        return 36000;
+    case IRMP_SIRCS_PROTOCOL:
+        return 40000;
+    default:
+        return 38000;
+    }
+}
+
+static size_t ir_cache_entry_size(const ir_cache_entry_t *entry)
+{
+    return sizeof(ir_cache_entry_t) + entry->num_symbol * sizeof(rmt_symbol_word_t);
+}
+
+static void ir_cache_unlink(ir_cache_entry_t *entry)
+{
+    if (entry->prev) entry->prev->next = entry->next; else s_cache_head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev; else s_cache_tail = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void ir_cache_push_front(ir_cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = s_cache_head;
+    if (s_cache_head) s_cache_head->prev = entry; else s_cache_tail = entry;
+    s_cache_head = entry;
+}
+
+// Waits for the cached frame being sent and gives the pin back to IRSND
+static void ir_cache_tx_wait(void)
+{
+    if (s_tx_entry == NULL) {
+        return;
+    }
+    if (rmt_tx_wait_all_done(s_tx_channel, IR_CACHE_TX_TIMEOUT_MS) != ESP_OK) {
+        ESP_LOGE(TAG, "Cached frame transmit timed out");
+    }
+    esp_rom_gpio_connect_out_signal(IR_TX_PIN, s_irsnd_signal, false, false);
+    s_tx_entry = NULL;
+}
+
+static void ir_cache_remove(ir_cache_entry_t *entry)
+{
+    if (entry == s_tx_entry) {
+        ir_cache_tx_wait();
+    }
+    ir_cache_unlink(entry);
+    s_cache_stats.used_bytes -= ir_cache_entry_size(entry);
+    s_cache_stats.num_entry--;
+    free(entry);
+}
+
+static void ir_cache_evict(size_t budget_bytes)
+{
+    while (s_cache_tail != NULL && s_cache_stats.used_bytes > budget_bytes)
+    {
+        ir_cache_remove(s_cache_tail);
+        s_cache_stats.eviction++;
+    }
+}
+
+static ir_cache_entry_t *ir_cache_find(const IRMP_DATA *ir_code)
+{
+    for (ir_cache_entry_t *entry = s_cache_head; entry != NULL; entry = entry->next) {
+        if (ir_cache_is_same_code(&entry->code, ir_code)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Level/duration pairs are packed two per RMT symbol, durations longer than a symbol field are split
+static uint16_t ir_cache_encode(rmt_symbol_word_t *symbol_array, const uint16_t *duration_array, uint16_t num_duration)
+{
+    uint16_t num_half = 0;
+    for (uint16_t i = 0; i < num_duration; i++) {
+        uint32_t duration_us = (uint64_t) duration_array[i] * 1000000 / F_INTERRUPTS;
+        uint8_t level = (i % 2) == 0;
+        while (duration_us > 0)
+        {
+            uint32_t chunk_us = duration_us > IR_CACHE_MAX_DURATION_US ? IR_CACHE_MAX_DURATION_US : duration_us;
+            if (symbol_array != NULL) {
+                rmt_symbol_word_t *symbol = &symbol_array[num_half / 2];
+                if (num_half % 2 == 0) {
+                    symbol->duration0 = chunk_us;
+                    symbol->level0 = level;
+                    symbol->duration1 = 0;
+                    symbol->level1 = 0;
+                } else {
+                    symbol->duration1 = chunk_us;
+                    symbol->level1 = level;
+                }
+            }
+            duration_us -= chunk_us;
+            num_half++;
+        }
+    }
+    return (num_half + 1) / 2;
+}
+
+// Starts the frame and returns, the caller holds s_cache_mutex
+static esp_err_t ir_cache_transmit(ir_cache_entry_t *entry)
+{
+    rmt_transmit_config_t transmit_config = {
+        .loop_count = 0,
+    };
+    esp_err_t err = ESP_OK;
+    if (entry->carrier_hz != s_tx_carrier_hz) {
+        rmt_carrier_config_t carrier_config = {
+            .frequency_hz = entry->carrier_hz,
+            .duty_cycle = IR_CACHE_RMT_DUTY_CYCLE,
+        };
+        err = rmt_apply_carrier(s_tx_channel, &carrier_config);
+        s_tx_carrier_hz = err == ESP_OK ? entry->carrier_hz : 0;
+    }
+    if (err != ESP_OK)
+        return err;
+    esp_rom_gpio_connect_out_signal(IR_TX_PIN, s_rmt_signal, false, false);
+    err = rmt_transmit(s_tx_channel, s_copy_encoder, entry->symbol, entry->num_symbol * sizeof(rmt_symbol_word_t), &transmit_config);
+    if (err != ESP_OK) {
+        esp_rom_gpio_connect_out_signal(IR_TX_PIN, s_irsnd_signal, false, false);
+        return err;
+    }
+    s_tx_entry = entry;
+    return ESP_OK;
+}
+
+void ir_cache_capture_edge(uint8_t is_on)
+{
+    if (!s_is_capturing || is_on == s_capture_level) {
+        return;
+    }
+    if (s_capture_level || s_capture_num_duration > 0) {
+        if (s_capture_num_duration < IR_CACHE_MAX_EDGE) {
+            s_capture_duration_array[s_capture_num_duration++] = s_capture_tick - s_capture_edge_tick;
+        } else {
+            s_capture_is_overflow = 1;
+        }
+    }
+    s_capture_edge_tick = s_capture_tick;
+    s_capture_level = is_on;
+}
+
+esp_err_t ir_cache_init(void)
+{
+    rmt_copy_encoder_config_t encoder_config = {};
+    s_cache_mutex = mem_mutex_create(MEM_SEMAPHORE(s_cache_mutex));
+    if (s_cache_mutex == NULL)
+        return ESP_ERR_NO_MEM;
+    if (rmt_new_copy_encoder(&encoder_config, &s_copy_encoder) != ESP_OK)
+        return ESP_FAIL;
+
+    // irsnd_init already routed the pin, creating the channel routes it to RMT so both signals are known
+    rmt_tx_channel_config_t tx_config = {
+        .gpio_num = IR_TX_PIN,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = IR_CACHE_RMT_RESOLUTION_HZ,
+        .mem_block_symbols = 64,
+        .trans_queue_depth = 1,
+    };
+    s_irsnd_signal = GPIO.func_out_sel_cfg[IR_TX_PIN].func_sel;
+    if (rmt_new_tx_channel(&tx_config, &s_tx_channel) != ESP_OK)
+        return ESP_FAIL;
+    s_rmt_signal = GPIO.func_out_sel_cfg[IR_TX_PIN].func_sel;
+    esp_rom_gpio_connect_out_signal(IR_TX_PIN, s_irsnd_signal, false, false);
+    if (rmt_enable(s_tx_channel) != ESP_OK)
+        return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t ir_cache_send(const IRMP_DATA *ir_code)
+{
+    xSemaphoreTake(s_cache_mutex, portMAX_DELAY);
+    ir_cache_entry_t *entry = ir_cache_find(ir_code);
+    if (entry == NULL) {
+        s_cache_stats.miss++;
+        xSemaphoreGive(s_cache_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    ir_cache_unlink(entry);
+    ir_cache_push_front(entry);
+
+    // The caller took ir_mutex with ir_tx_take, IRSND and the channel are idle
+    ir_cache_tx_wait();
+    esp_err_t err = ir_cache_transmit(entry);
+    if (err == ESP_OK) {
+        s_cache_stats.hit++;
+        s_cache_stats.encode_saved_us += entry->encode_us;
+    } else {
+        ESP_LOGE(TAG, "Cached frame transmit failed: %s", esp_err_to_name(err));
+    }
+    xSemaphoreGive(s_cache_mutex);
+    return err;
+}
+
+void ir_cache_wait_idle(void)
+{
+    xSemaphoreTake(s_cache_mutex, portMAX_DELAY);
+    ir_cache_tx_wait();
+    xSemaphoreGive(s_cache_mutex);
+}
+
+uint8_t ir_cache_is_sending(void)
+{
+    return s_tx_entry != NULL;
+}
+
+// Returns 0 while the previous capture is not stored yet, that frame is then just not cached
+uint8_t ir_cache_capture_begin(const IRMP_DATA *ir_code)
+{
+    if (s_capture_is_pending) {
+        return 0;
+    }
+    s_capture_is_pending = 1;
+    s_capture_is_busy = 0;
+    s_capture_code = *ir_code;
+    s_capture_is_overflow = 0;
+    s_capture_level = 0;
+    s_capture_num_duration = 0;
+    s_capture_tick = 0;
+    s_capture_edge_tick = 0;
+    s_capture_isr_us = 0;
+    s_is_capturing = 1;
+    return 1;
+}
+
+void ir_cache_capture_tick(uint32_t isr_us, uint8_t is_busy)
+{
+    s_capture_tick++;
+    s_capture_isr_us += isr_us;
+    if (is_busy) {
+        s_capture_is_busy = 1;
+    } else if (s_capture_is_busy) {
+        s_is_capturing = 0;
+    }
+}
+
+uint8_t ir_cache_is_capturing(void)
+{
+    return s_is_capturing;
+}
+
+static esp_err_t ir_cache_capture_store(void)
+{
+    if (s_capture_is_overflow || s_capture_level || s_capture_num_duration == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Keep the pause IRSND inserts after the frame so back to back cached sends stay apart
+    if (s_capture_num_duration < IR_CACHE_MAX_EDGE) {
+        s_capture_duration_array[s_capture_num_duration++] = s_capture_tick - s_capture_edge_tick;
+    }
+
+    uint16_t num_symbol = ir_cache_encode(NULL, s_capture_duration_array, s_capture_num_duration);
+    size_t entry_size = sizeof(ir_cache_entry_t) + num_symbol * sizeof(rmt_symbol_word_t);
+    xSemaphoreTake(s_cache_mutex, portMAX_DELAY);
+    if (entry_size > s_cache_stats.budget_bytes || ir_cache_find(&s_capture_code) != NULL) {
+        xSemaphoreGive(s_cache_mutex);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ir_cache_evict(s_cache_stats.budget_bytes - entry_size);
+    ir_cache_entry_t *entry = calloc(1, entry_size);
+    if (entry == NULL) {
+        xSemaphoreGive(s_cache_mutex);
+        return ESP_ERR_NO_MEM;
+    }
+    entry->code = s_capture_code;
+    entry->carrier_hz = ir_cache_carrier_hz(s_capture_code.protocol);
+    entry->encode_us = s_capture_isr_us;
+    entry->num_symbol = num_symbol;
+    ir_cache_encode(entry->symbol, s_capture_duration_array, s_capture_num_duration);
+    ir_cache_push_front(entry);
+    s_cache_stats.used_bytes += entry_size;
+    s_cache_stats.num_entry++;
+    xSemaphoreGive(s_cache_mutex);
+    return ESP_OK;
+}
+
+// Called without ir_mutex by the sender whose ir_cache_capture_begin returned 1
+esp_err_t ir_cache_capture_end(void)
+{
+    TickType_t start_tick = xTaskGetTickCount();
+    while (s_is_capturing && (xTaskGetTickCount() - start_tick) < pdMS_TO_TICKS(IR_CACHE_TX_TIMEOUT_MS))
+    {
+        vTaskDelay(1);
+    }
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    if (!s_is_capturing) {
+        err = ir_cache_capture_store();
+    }
+    s_is_capturing = 0;
+    s_capture_is_pending = 0;
+    return err;
+}
+
+void ir_cache_invalidate(const IRMP_DATA *ir_code)
+{
+    xSemaphoreTake(s_cache_mutex, portMAX_DELAY);
+    ir_cache_entry_t *entry = ir_cache_find(ir_code);
+    if (entry != NULL) {
+        ir_cache_remove(entry);
+    }
+    xSemaphoreGive(s_cache_mutex);
+}
+
+void ir_cache_clear(void)
+{
+    xSemaphoreTake(s_cache_mutex, portMAX_DELAY);
+    while (s_cache_head != NULL)
+    {
+        ir_cache_remove(s_cache_head);
+    }
+    xSemaphoreGive(s_cache_mutex);
+}
+
+esp_err_t ir_cache_set_budget(size_t budget_bytes)
+{
+    xSemaphoreTake(s_cache_mutex, portMAX_DELAY);
+    s_cache_stats.budget_bytes = budget_bytes;
+    ir_cache_evict(budget_bytes);
+    xSemaphoreGive(s_cache_mutex);
+    return ESP_OK;
+}
+
+esp_err_t ir_cache_get_stats(ir_cache_stats_t *stats)
+{
+    xSemaphoreTake(s_cache_mutex, portMAX_DELAY);
+    *stats = s_cache_stats;
+    xSemaphoreGive(s_cache_mutex);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t ir_cache_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t ir_cache_send(const IRMP_DATA *ir_code)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void ir_cache_wait_idle(void)
+{
+}
+
+uint8_t ir_cache_is_sending(void)
+{
+    return 0;
+}
+
+uint8_t ir_cache_capture_begin(const IRMP_DATA *ir_code)
+{
+    return 0;
+}
+
+void ir_cache_capture_tick(uint32_t isr_us, uint8_t is_busy)
+{
+}
+
+void ir_cache_capture_edge(uint8_t is_on)
+{
+}
+
+uint8_t ir_cache_is_capturing(void)
+{
+    return 0;
+}
+
+esp_err_t ir_cache_capture_end(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void ir_cache_invalidate(const IRMP_DATA *ir_code)
+{
+}
+
+void ir_cache_clear(void)
+{
+}
+
+esp_err_t ir_cache_set_budget(size_t budget_bytes)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ir_cache_get_stats(ir_cache_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
\ No newline at end of file
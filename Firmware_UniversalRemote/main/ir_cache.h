@@ -0,0 +1,59 @@
+#ifndef IR_CACHE_H
+#define IR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "irmp.h"
+#include "irsnd.h"
+
+// Frames are captured through the IRSND callback, the project CMakeLists.txt sets IRSND_USE_CALLBACK for every component
+#ifndef IR_CACHE_ENABLE
+#if defined(IRSND_USE_CALLBACK) && IRSND_USE_CALLBACK
+#define IR_CACHE_ENABLE             1
+#else
+#define IR_CACHE_ENABLE             0
+#endif
+#endif
+
+#ifndef IR_CACHE_BUDGET_BYTES
+#define IR_CACHE_BUDGET_BYTES       4096
+#endif
+#define IR_CACHE_MAX_EDGE           512
+#define IR_CACHE_RMT_RESOLUTION_HZ  1000000
+#define IR_CACHE_RMT_DUTY_CYCLE     0.33
+#define IR_CACHE_TX_TIMEOUT_MS      1000
+
+typedef struct {
+    uint32_t hit;
+    uint32_t miss;
+    uint32_t eviction;
+    uint16_t num_entry;
+    size_t used_bytes;
+    size_t budget_bytes;
+    uint64_t encode_saved_us;
+} ir_cache_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ir_cache_init(void);
+esp_err_t ir_cache_send(const IRMP_DATA *ir_code);
+void ir_cache_wait_idle(void);
+uint8_t ir_cache_is_sending(void);
+uint8_t ir_cache_capture_begin(const IRMP_DATA *ir_code);
+void ir_cache_capture_tick(uint32_t isr_us, uint8_t is_busy);
+void ir_cache_capture_edge(uint8_t is_on);
+uint8_t ir_cache_is_capturing(void);
+esp_err_t ir_cache_capture_end(void);
+void ir_cache_invalidate(const IRMP_DATA *ir_code);
+void ir_cache_clear(void);
+esp_err_t ir_cache_set_budget(size_t budget_bytes);
+esp_err_t ir_cache_get_stats(ir_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
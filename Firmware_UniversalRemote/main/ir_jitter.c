@@ -0,0 +1,231 @@
+#include <string.h>
+#include "ir_jitter.h"
+#include "ir_manage.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "mem_budget.h"
+
+static const char *TAG = "IR_JITTER";
+
+static volatile uint8_t s_is_active;
+static volatile uint8_t s_is_frame;
+// The timer callback ends the frame when IRSND goes idle, the sender that began it clears s_is_frame_pending
+static volatile uint8_t s_is_frame_busy;
+static volatile uint8_t s_is_frame_pending;
+static ir_jitter_report_t s_report;
+
+// Edges of the frame in flight, timestamped with the start of the timer callback that switched the output
+static volatile uint32_t s_tick;
+static volatile int64_t s_tick_us;
+static volatile uint16_t s_num_edge;
+static uint32_t s_edge_tick_array[IR_JITTER_MAX_EDGE];
+static int64_t s_edge_us_array[IR_JITTER_MAX_EDGE];
+static uint8_t s_edge_level_array[IR_JITTER_MAX_EDGE];
+
+static volatile uint8_t s_is_load_running;
+static volatile uint32_t s_num_request;
+static uint8_t s_num_load_task;
+static SemaphoreHandle_t s_load_done_semp;
+MEM_SEMAPHORE_BUFFER(s_load_done_semp);
+
+static void IRAM_ATTR ir_jitter_hist_add(ir_jitter_hist_t *hist, int32_t error_us, int32_t nominal_us)
+{
+    uint32_t abs_us = error_us < 0 ? -error_us : error_us;
+    uint32_t bin = abs_us / IR_JITTER_BIN_US;
+    hist->bin[bin < IR_JITTER_NUM_BIN ? bin : IR_JITTER_NUM_BIN - 1]++;
+    if (hist->count == 0 || error_us < hist->min_us) {
+        hist->min_us = error_us;
+    }
+    if (hist->count == 0 || error_us > hist->max_us) {
+        hist->max_us = error_us;
+    }
+    hist->count++;
+    hist->sum_abs_us += abs_us;
+    if (abs_us * 100 > nominal_us * IR_JITTER_TOLERANCE_PCT) {
+        hist->num_out_of_tolerance++;
+    }
+}
+
+esp_err_t ir_jitter_start(void)
+{
+    memset(&s_report, 0, sizeof(s_report));
+    s_is_active = 1;
+    return ESP_OK;
+}
+
+void ir_jitter_stop(void)
+{
+    s_is_active = 0;
+}
+
+uint8_t ir_jitter_is_active(void)
+{
+    return s_is_active;
+}
+
+// Returns 0 while the previous frame is not evaluated yet, that frame is then not measured
+uint8_t ir_jitter_frame_begin(void)
+{
+    if (!s_is_active || s_is_frame_pending) {
+        return 0;
+    }
+    s_is_frame_pending = 1;
+    s_is_frame_busy = 0;
+    s_num_edge = 0;
+    s_tick = 0;
+    s_tick_us = 0;
+    s_is_frame = 1;
+    return 1;
+}
+
+// Called first thing in every IR timer callback, the gap to the previous one should be IR_PERIOD_US
+void IRAM_ATTR ir_jitter_tick(void)
+{
+    if (!s_is_frame) {
+        return;
+    }
+    if (irsnd_is_busy()) {
+        s_is_frame_busy = 1;
+    } else if (s_is_frame_busy) {
+        s_is_frame = 0;
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    if (s_tick_us) {
+        ir_jitter_hist_add(&s_report.tick, (now_us - s_tick_us) - IR_PERIOD_US, IR_PERIOD_US);
+    }
+    s_tick++;
+    s_tick_us = now_us;
+}
+
+void IRAM_ATTR ir_jitter_edge(uint8_t is_on)
+{
+    if (!s_is_frame) {
+        return;
+    }
+    if (s_num_edge >= IR_JITTER_MAX_EDGE) {
+        s_report.num_overflow++;
+        s_is_frame = 0;
+        return;
+    }
+    s_edge_tick_array[s_num_edge] = s_tick;
+    s_edge_us_array[s_num_edge] = s_tick_us;
+    s_edge_level_array[s_num_edge] = is_on;
+    s_num_edge++;
+}
+
+// Compares every mark and space with the number of ticks IRSND meant it to last. Called without ir_mutex by the
+// sender whose ir_jitter_frame_begin returned 1, a frame that does not end in time is counted as an overflow
+void ir_jitter_frame_end(void)
+{
+    TickType_t start_tick = xTaskGetTickCount();
+    while (s_is_frame && (xTaskGetTickCount() - start_tick) < pdMS_TO_TICKS(IR_JITTER_FRAME_TIMEOUT_MS))
+    {
+        vTaskDelay(1);
+    }
+    if (s_is_frame) {
+        s_is_frame = 0;
+        s_report.num_overflow++;
+        s_is_frame_pending = 0;
+        return;
+    }
+    for (uint16_t i = 1; i < s_num_edge; i++) {
+        int32_t nominal_us = (s_edge_tick_array[i] - s_edge_tick_array[i - 1]) * IR_PERIOD_US;
+        int32_t actual_us = s_edge_us_array[i] - s_edge_us_array[i - 1];
+        ir_jitter_hist_add(s_edge_level_array[i - 1] ? &s_report.mark : &s_report.space, actual_us - nominal_us, nominal_us);
+    }
+    s_report.num_frame++;
+    s_is_frame_pending = 0;
+}
+
+// Each client opens a new connection per request so both httpd and the lwIP stack stay busy
+static void ir_jitter_load_task(void *args)
+{
+    esp_http_client_config_t config = {
+        .url = IR_JITTER_LOAD_URL,
+        .timeout_ms = IR_JITTER_LOAD_TIMEOUT_MS,
+    };
+    while (s_is_load_running)
+    {
+        esp_http_client_handle_t client = esp_http_client_init(&config);
+        if (client == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        if (esp_http_client_perform(client) == ESP_OK) {
+            __atomic_fetch_add(&s_num_request, 1, __ATOMIC_RELAXED);
+        }
+        esp_http_client_cleanup(client);
+    }
+    xSemaphoreGive(s_load_done_semp);
+    vTaskDelete(NULL);
+}
+
+esp_err_t ir_jitter_load_start(uint8_t num_client)
+{
+    if (num_client > IR_JITTER_MAX_LOAD_CLIENT)
+        return ESP_ERR_INVALID_ARG;
+    if (s_num_load_task)
+        return ESP_ERR_INVALID_STATE;
+    if (s_load_done_semp == NULL) {
+        s_load_done_semp = mem_counting_create(IR_JITTER_MAX_LOAD_CLIENT, 0, MEM_SEMAPHORE(s_load_done_semp));
+        if (s_load_done_semp == NULL)
+            return ESP_ERR_NO_MEM;
+    }
+    s_num_request = 0;
+    s_is_load_running = 1;
+    // Same core as the esp_timer task that runs ir_ISR, that is where the load competes with IR timing
+    for (uint8_t i = 0; i < num_client; i++) {
+        if (xTaskCreatePinnedToCore(&ir_jitter_load_task, "JITTER_LOAD_TASK", IR_JITTER_LOAD_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, NULL, 0) != pdPASS) {
+            ir_jitter_load_stop();
+            return ESP_ERR_NO_MEM;
+        }
+        s_num_load_task++;
+    }
+    return ESP_OK;
+}
+
+void ir_jitter_load_stop(void)
+{
+    s_is_load_running = 0;
+    while (s_num_load_task)
+    {
+        if (xSemaphoreTake(s_load_done_semp, pdMS_TO_TICKS(IR_JITTER_LOAD_TIMEOUT_MS * 2)) != pdTRUE) {
+            ESP_LOGW(TAG, "Load client did not stop");
+            break;
+        }
+        s_num_load_task--;
+    }
+}
+
+// Marks and spaces are only seen through the IRSND callback
+esp_err_t ir_jitter_run(uint8_t ir_remote_id, uint8_t ir_code_id, uint16_t count, uint8_t num_client)
+{
+#if !IRSND_USE_CALLBACK
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+    if (!ir_is_learned_tv(ir_code_id, ir_remote_id))
+        return ESP_ERR_NOT_FOUND;
+    esp_err_t err = ir_jitter_load_start(num_client);
+    if (err != ESP_OK)
+        return err;
+    ir_jitter_start();
+    s_report.num_client = num_client;
+    for (uint16_t i = 0; i < count && err == ESP_OK; i++) {
+        err = ir_send_code_tv(ir_code_id, ir_remote_id);
+        vTaskDelay(pdMS_TO_TICKS(IR_JITTER_SEND_GAP_MS));
+    }
+    ir_jitter_stop();
+    s_report.num_request = s_num_request;
+    ir_jitter_load_stop();
+    return err;
+}
+
+void ir_jitter_get_report(ir_jitter_report_t *report)
+{
+    *report = s_report;
+}
\ No newline at end of file
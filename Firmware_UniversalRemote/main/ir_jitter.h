@@ -0,0 +1,58 @@
+#ifndef IR_JITTER_H
+#define IR_JITTER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define IR_JITTER_MAX_EDGE          256
+#define IR_JITTER_NUM_BIN           16
+#define IR_JITTER_BIN_US            5
+#define IR_JITTER_TOLERANCE_PCT     10
+#define IR_JITTER_SEND_GAP_MS       100
+#define IR_JITTER_FRAME_TIMEOUT_MS  1000
+#define IR_JITTER_MAX_LOAD_CLIENT   4
+#define IR_JITTER_LOAD_URL          "http://127.0.0.1/"
+#define IR_JITTER_LOAD_TIMEOUT_MS   2000
+#define IR_JITTER_LOAD_STACK_SIZE   4096
+
+// Error against nominal in IR_JITTER_BIN_US wide bins of |error|, the last bin also counts everything above it
+typedef struct {
+    uint32_t count;
+    int32_t min_us;
+    int32_t max_us;
+    uint64_t sum_abs_us;
+    uint32_t num_out_of_tolerance;
+    uint32_t bin[IR_JITTER_NUM_BIN];
+} ir_jitter_hist_t;
+
+typedef struct {
+    uint8_t num_client;
+    uint32_t num_frame;
+    uint32_t num_overflow;
+    uint32_t num_request;
+    ir_jitter_hist_t tick;
+    ir_jitter_hist_t mark;
+    ir_jitter_hist_t space;
+} ir_jitter_report_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ir_jitter_start(void);
+void ir_jitter_stop(void);
+uint8_t ir_jitter_is_active(void);
+uint8_t ir_jitter_frame_begin(void);
+void ir_jitter_tick(void);
+void ir_jitter_edge(uint8_t is_on);
+void ir_jitter_frame_end(void);
+esp_err_t ir_jitter_load_start(uint8_t num_client);
+void ir_jitter_load_stop(void);
+esp_err_t ir_jitter_run(uint8_t ir_remote_id, uint8_t ir_code_id, uint16_t count, uint8_t num_client);
+void ir_jitter_get_report(ir_jitter_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
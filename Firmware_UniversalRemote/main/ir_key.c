@@ -0,0 +1,85 @@
+#include <ctype.h>
+#include <string.h>
+#include "ir_key.h"
+#include "esp_log.h"
+
+static const char *TAG = "IR_KEY";
+
+#define IR_TV_KEY_NAME(name, label, style, grid)     #name,
+#define IR_TV_KEY_VIEW(name, label, style, grid)     {label, #style, #grid},
+
+static const char *s_ir_key_name_array[IR_TV_NUM_CODE] = {
+    IR_TV_KEY_TABLE(IR_TV_KEY_NAME)
+};
+
+static const ir_key_view_t s_ir_key_view_array[IR_TV_NUM_CODE] = {
+    IR_TV_KEY_TABLE(IR_TV_KEY_VIEW)
+};
+
+// Slot holds ir_code_id + 1, 0 is an empty slot
+static uint8_t s_ir_key_slot_array[IR_KEY_HASH_SIZE];
+static uint32_t s_ir_key_seed;
+
+static uint32_t ir_key_hash(uint32_t seed, const char *name, size_t length)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < length && name[i] != '\0'; i++) {
+        hash = (hash ^ (uint8_t) toupper((unsigned char) name[i])) * 16777619u;
+    }
+    return hash % IR_KEY_HASH_SIZE;
+}
+
+static uint8_t ir_key_try_seed(uint32_t seed)
+{
+    memset(s_ir_key_slot_array, 0, sizeof(s_ir_key_slot_array));
+    for (uint8_t i = 0; i < IR_TV_NUM_CODE; i++) {
+        uint32_t slot = ir_key_hash(seed, s_ir_key_name_array[i], strlen(s_ir_key_name_array[i]));
+        if (s_ir_key_slot_array[slot] != 0) {
+            return 0;
+        }
+        s_ir_key_slot_array[slot] = i + 1;
+    }
+    return 1;
+}
+
+esp_err_t ir_key_init(void)
+{
+    if (ir_key_try_seed(IR_KEY_HASH_SEED)) {
+        s_ir_key_seed = IR_KEY_HASH_SEED;
+        return ESP_OK;
+    }
+    for (uint32_t seed = 0; seed < IR_KEY_MAX_SEED; seed++) {
+        if (ir_key_try_seed(seed)) {
+            s_ir_key_seed = seed;
+            ESP_LOGW(TAG, "Key table changed, set IR_KEY_HASH_SEED to %lu", (unsigned long) seed);
+            return ESP_OK;
+        }
+    }
+    ESP_LOGE(TAG, "No collision free seed, increase IR_KEY_HASH_SIZE");
+    return ESP_FAIL;
+}
+
+const char *ir_key_get_name(uint8_t ir_code_id)
+{
+    if (ir_code_id >= IR_TV_NUM_CODE) return NULL;
+    return s_ir_key_name_array[ir_code_id];
+}
+
+const ir_key_view_t *ir_key_get_view(uint8_t ir_code_id)
+{
+    if (ir_code_id >= IR_TV_NUM_CODE) return NULL;
+    return &s_ir_key_view_array[ir_code_id];
+}
+
+int ir_key_lookup(const char *name, size_t length)
+{
+    uint8_t slot = s_ir_key_slot_array[ir_key_hash(s_ir_key_seed, name, length)];
+    if (slot == 0) {
+        return -1;
+    }
+    const char *key_name = s_ir_key_name_array[slot - 1];
+    if (strncasecmp(name, key_name, length) != 0 || key_name[length] != '\0') {
+        return -1;
+    }
+    return slot - 1;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef IR_KEY_H
+#define IR_KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ir_manage.h"
+
+// IR_KEY_HASH_SEED is collision free for IR_TV_KEY_TABLE, ir_key_init searches a new one if the table changes
+#define IR_KEY_HASH_SIZE            256
+#define IR_KEY_HASH_SEED            117
+#define IR_KEY_MAX_SEED             65536
+
+// How the web UI draws a key, taken from the IR_TV_KEY_TABLE entry
+typedef struct {
+    const char *label;
+    const char *style;
+    const char *grid;
+} ir_key_view_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ir_key_init(void);
+const char *ir_key_get_name(uint8_t ir_code_id);
+const ir_key_view_t *ir_key_get_view(uint8_t ir_code_id);
+int ir_key_lookup(const char *name, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
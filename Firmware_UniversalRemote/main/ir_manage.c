@@ -1,7 +1,14 @@
 #include "ir_manage.h"
+#include "ir_pool.h"
+#include "ir_cache.h"
+#include "ir_jitter.h"
+#include "ir_verify.h"
+#include "mem_budget.h"
+#include "record_store.h"
 #include "esp_log.h"
 #include "nvs.h"
 #include "esp_timer.h"
+#include "esp_rom_crc.h"
 #include "pin_config.h"
 
 static const char *TAG = "IR_MANAGE";
@@ -16,14 +23,46 @@ SemaphoreHandle_t  ir_mutex;
 static SemaphoreHandle_t ir_send_semp;
 
 static TaskHandle_t s_ir_receive_task_handle;
+static QueueHandle_t s_ir_tx_queue;
+static ir_learn_done_cb_t s_ir_learn_done_cb;
+
+typedef struct {
+    uint8_t ir_code_id;
+    uint8_t ir_remote_id;
+    uint8_t source;
+    int64_t queued_us;
+    ir_tx_done_cb_t done_cb;
+    void *ctx;
+} ir_tx_request_t;
+
+MEM_SEMAPHORE_BUFFER(s_ir_mutex);
+MEM_SEMAPHORE_BUFFER(s_ir_send_semp);
+MEM_QUEUE_BUFFER(s_ir_tx_queue, IR_TX_QUEUE_LEN, sizeof(ir_tx_request_t));
+MEM_TASK_BUFFER(s_ir_receive_task, IR_RECEIVE_STACK_SIZE);
+MEM_TASK_BUFFER(s_ir_tx_task, IR_TX_STACK_SIZE);
+
+// Requests of a source count from enqueue until their done_cb returned, including the one being sent
+static const uint8_t s_ir_tx_slot_array[IR_TX_NUM_SOURCE] = {IR_TX_WEB_SLOTS, IR_TX_QUEUE_LEN - IR_TX_WEB_SLOTS};
+static uint8_t s_ir_tx_inflight_array[IR_TX_NUM_SOURCE];
+static portMUX_TYPE s_ir_tx_lock = portMUX_INITIALIZER_UNLOCKED;
 
 IRMP_DATA irmp_data;
 static long s_ir_code_id;
 static long s_ir_remote_id;
 
 static const char *s_ir_tv_key_name_array[IR_TV_NUM_REMOTE] = {IR_TV_1, IR_TV_2, IR_TV_3, IR_TV_4, IR_TV_5};
-static IRMP_DATA s_ir_code_tv_array[IR_TV_NUM_REMOTE][IR_TV_NUM_CODE];
+static uint8_t s_ir_code_tv_ref_array[IR_TV_NUM_REMOTE][IR_TV_NUM_CODE];
 static char s_ir_code_tv_info_array[IR_TV_NUM_REMOTE][IR_INFO_LEN];
+// Set when NVS holds IR records of a newer firmware, they are never overwritten
+static uint8_t s_ir_is_read_only;
+
+typedef struct {
+    uint8_t num_remote;
+    uint8_t num_code;
+    uint16_t num_entry;
+} ir_codes_header_t;
+
+#define IR_CODES_MAX_LEN            (sizeof(ir_codes_header_t) + IR_POOL_MAX_ENTRY * sizeof(IRMP_DATA) + sizeof(s_ir_code_tv_ref_array))
 
 void ir_receive_task(void *args)
 {
@@ -55,62 +94,317 @@ void ir_receive_task(void *args)
             now_tick = xTaskGetTickCount();
         }
         gpio_set_level(LED_PIN, 1);   
+        if (s_ir_learn_done_cb) {
+            s_ir_learn_done_cb(s_ir_code_id, s_ir_remote_id, is_ir_detected == TRUE ? ESP_OK : ESP_ERR_TIMEOUT);
+        }
         xSemaphoreGive(ir_send_semp);
     }
 }
 
-void ir_ISR(void *args)
+void ir_tx_task(void *args)
 {
-    if (!irsnd_ISR()) {                                   
-        irmp_ISR();                     
+    ir_tx_request_t request;
+    while (1)
+    {
+        if (xQueueReceive(s_ir_tx_queue, &request, portMAX_DELAY) != pdTRUE)
+            continue;
+        esp_err_t err = ir_send_code_tv(request.ir_code_id, request.ir_remote_id);
+        if (request.done_cb) {
+            request.done_cb(request.ir_code_id, request.ir_remote_id, err, request.queued_us, request.ctx);
+        }
+        taskENTER_CRITICAL(&s_ir_tx_lock);
+        s_ir_tx_inflight_array[request.source]--;
+        taskEXIT_CRITICAL(&s_ir_tx_lock);
+    }
+}
+
+#if IRSND_USE_CALLBACK
+static void IRAM_ATTR ir_irsnd_cb(uint8_t is_on)
+{
+    ir_cache_capture_edge(is_on);
+    ir_jitter_edge(is_on);
+}
+#endif
+
+void IRAM_ATTR ir_ISR(void *args)
+{
+    uint8_t is_busy;
+    ir_jitter_tick();
+#if IR_CACHE_ENABLE
+    // Time the encoder while a frame is captured, this is what a cache hit saves
+    if (ir_cache_is_capturing()) {
+        int64_t start_us = esp_timer_get_time();
+        is_busy = irsnd_ISR();
+        ir_cache_capture_tick(esp_timer_get_time() - start_us, is_busy);
+    } else {
+        is_busy = irsnd_ISR();
+    }
+#else
+    is_busy = irsnd_ISR();
+#endif
+    // In verify mode the receiver keeps listening while we send, so it decodes our own frame
+    if (!is_busy || ir_verify_is_enabled()) {
+        irmp_ISR();
     }
 }
 
 esp_err_t ir_init(void)
 {
-    ir_mutex = xSemaphoreCreateMutex();
+    ir_mutex = mem_mutex_create(MEM_SEMAPHORE(s_ir_mutex));
     if (ir_mutex == NULL)
         return ESP_ERR_NO_MEM;
-    ir_send_semp = xSemaphoreCreateBinary();
+    ir_send_semp = mem_binary_create(MEM_SEMAPHORE(s_ir_send_semp));
     if (ir_send_semp == NULL)
         return ESP_ERR_NO_MEM;
     xSemaphoreGive(ir_send_semp);    
+    if (ir_pool_init() != ESP_OK)
+        return ESP_ERR_NO_MEM;
     irmp_init();
     irsnd_init();
+    if (ir_cache_init() != ESP_OK)
+        return ESP_FAIL;
+#if IRSND_USE_CALLBACK
+    irsnd_set_callback_ptr(ir_irsnd_cb);
+#endif
     s_ir_timer_args.callback = (void*) &ir_ISR;
     s_ir_timer_args.name = "ir_ISR";
     ESP_ERROR_CHECK(esp_timer_create(&s_ir_timer_args, &s_ir_timer_handle));
     ESP_ERROR_CHECK(esp_timer_start_periodic(s_ir_timer_handle, IR_PERIOD_US));
-    xTaskCreatePinnedToCore(&ir_receive_task, "IR_RECEIVE_TASK", 2048, NULL, 2, &s_ir_receive_task_handle, 1);
+    s_ir_tx_queue = mem_queue_create(IR_TX_QUEUE_LEN, sizeof(ir_tx_request_t), MEM_QUEUE(s_ir_tx_queue));
+    if (s_ir_tx_queue == NULL)
+        return ESP_ERR_NO_MEM;
+    if (mem_task_create(&ir_receive_task, "IR_RECEIVE_TASK", IR_RECEIVE_STACK_SIZE, NULL, 2, &s_ir_receive_task_handle, 1,
+                        MEM_TASK_STACK(s_ir_receive_task), MEM_TASK_TCB(s_ir_receive_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    if (mem_task_create(&ir_tx_task, "IR_TX_TASK", IR_TX_STACK_SIZE, NULL, 2, NULL, 1, MEM_TASK_STACK(s_ir_tx_task), MEM_TASK_TCB(s_ir_tx_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+// Drops references into codes the pool does not have, then takes the remote's share of each code
+static void ir_retain_tv(uint8_t ir_remote_id)
+{
+    for (int j = 0; j < IR_TV_NUM_CODE; j++) {
+        if (!ir_pool_is_valid(s_ir_code_tv_ref_array[ir_remote_id][j])) {
+            ESP_LOGE(TAG, "Invalid IR code reference in TV remote %d", ir_remote_id + 1);
+            s_ir_code_tv_ref_array[ir_remote_id][j] = 0;
+        }
+        ir_pool_retain(s_ir_code_tv_ref_array[ir_remote_id][j]);
+    }
+}
+
+// Unversioned blob from before records, either the reference array or one IRMP_DATA per key from before the code pool
+static esp_err_t ir_load_legacy_tv(uint8_t ir_remote_id, uint8_t *is_rewrite)
+{
+    const char *key = s_ir_tv_key_name_array[ir_remote_id];
+    size_t length = 0;
+    esp_err_t err = nvs_get_blob(s_ir_handle, key, NULL, &length);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "Empty IR code detected in TV remote %d", ir_remote_id + 1);
+        return ESP_OK;
+    }
+    if (err != ESP_OK)
+        return err;
+    if (length == sizeof(s_ir_code_tv_ref_array[ir_remote_id])) {
+        err = nvs_get_blob(s_ir_handle, key, s_ir_code_tv_ref_array[ir_remote_id], &length);
+        if (err != ESP_OK)
+            return err;
+        ir_retain_tv(ir_remote_id);
+    } else if (length == sizeof(IRMP_DATA) * IR_TV_NUM_CODE) {
+        IRMP_DATA ir_code_array[IR_TV_NUM_CODE];
+        err = nvs_get_blob(s_ir_handle, key, ir_code_array, &length);
+        if (err != ESP_OK)
+            return err;
+        for (int j = 0; j < IR_TV_NUM_CODE; j++) {
+            ir_add_code_tv(ir_code_array[j], j, ir_remote_id);
+        }
+    } else {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    record_count_migrated();
+    *is_rewrite = 1;
     return ESP_OK;
 }
 
+// Reference record of one remote from before the combined record, shorter arrays start the new keys unlearned
+static esp_err_t ir_load_tv(uint8_t ir_remote_id, uint8_t *is_rewrite)
+{
+    uint8_t *ref_array = s_ir_code_tv_ref_array[ir_remote_id];
+    size_t length = sizeof(s_ir_code_tv_ref_array[ir_remote_id]);
+    uint16_t version = IR_TV_RECORD_VERSION;
+    esp_err_t err = record_read(s_ir_handle, s_ir_tv_key_name_array[ir_remote_id], ref_array, &length, &version);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+        return ir_load_legacy_tv(ir_remote_id, is_rewrite);
+    if (err == ESP_OK && version != IR_TV_RECORD_VERSION) {
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    if (err != ESP_OK) {
+        memset(ref_array, 0, sizeof(s_ir_code_tv_ref_array[ir_remote_id]));
+        return err;
+    }
+    if (length < sizeof(s_ir_code_tv_ref_array[ir_remote_id])) {
+        memset(ref_array + length, 0, sizeof(s_ir_code_tv_ref_array[ir_remote_id]) - length);
+        record_count_migrated();
+        *is_rewrite = 1;
+    }
+    ir_retain_tv(ir_remote_id);
+    return ESP_OK;
+}
+
+static esp_err_t ir_load_info_tv(uint8_t ir_remote_id, uint8_t *is_rewrite)
+{
+    const char *key = s_ir_tv_key_name_array[ir_remote_id];
+    char *info = s_ir_code_tv_info_array[ir_remote_id];
+    size_t length = IR_INFO_LEN;
+    uint16_t version = IR_INFO_RECORD_VERSION;
+    esp_err_t err = record_read(s_iri_handle, key, info, &length, &version);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        length = IR_INFO_LEN;
+        err = nvs_get_str(s_iri_handle, key, info, &length);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGI(TAG, "Empty IR information detected in TV remote %d", ir_remote_id + 1);
+            return ESP_OK;
+        }
+        if (err == ESP_OK) {
+            record_count_migrated();
+            *is_rewrite = 1;
+        }
+    } else if (err == ESP_OK && version != IR_INFO_RECORD_VERSION) {
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    info[IR_INFO_LEN - 1] = '\0';
+    if (err != ESP_OK) {
+        info[0] = '\0';
+    }
+    return err;
+}
+
+// Pool and references of older firmware, stored as separate records or blobs. The rewrite stores them combined
+static esp_err_t ir_load_legacy_codes(uint8_t *is_rewrite)
+{
+    esp_err_t err = ir_pool_load_legacy(s_ir_handle, IR_POOL_KEY);
+    if (err == ESP_ERR_NO_MEM || err == ESP_ERR_INVALID_VERSION)
+        return err;
+    if (err == ESP_OK) {
+        record_count_migrated();
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        // Stored references are dropped against the empty pool
+        ESP_LOGE(TAG, "IR code pool lost: %s", esp_err_to_name(err));
+    }
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        err = ir_load_tv(i, is_rewrite);
+        if (err == ESP_ERR_INVALID_VERSION)
+            return err;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "IR codes of TV remote %d lost: %s", i + 1, esp_err_to_name(err));
+        }
+    }
+    *is_rewrite = 1;
+    return ESP_OK;
+}
+
+// Pool first so the IRMP_DATA array stays aligned, then one row of references per remote. Records from
+// before keys or remotes were appended have fewer rows or shorter ones, the new keys start unlearned
+static esp_err_t ir_load_codes(uint8_t *is_rewrite)
+{
+    size_t length = IR_CODES_MAX_LEN;
+    uint16_t version = IR_CODES_RECORD_VERSION;
+    ir_codes_header_t header;
+    uint8_t *payload = malloc(length);
+    if (payload == NULL)
+        return ESP_ERR_NO_MEM;
+    esp_err_t err = record_read(s_ir_handle, IR_CODES_KEY, payload, &length, &version);
+    if (err == ESP_OK && version != IR_CODES_RECORD_VERSION) {
+        ESP_LOGE(TAG, "Unknown IR code record version %d", version);
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    if (err == ESP_OK) {
+        memcpy(&header, payload, length < sizeof(header) ? 0 : sizeof(header));
+        if (length < sizeof(header) || header.num_remote > IR_TV_NUM_REMOTE || header.num_code > IR_TV_NUM_CODE
+            || length != sizeof(header) + header.num_entry * sizeof(IRMP_DATA) + header.num_remote * header.num_code) {
+            ESP_LOGE(TAG, "Invalid IR code record size %d", (int) length);
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+    if (err == ESP_OK) {
+        err = ir_pool_set((const IRMP_DATA *) (payload + sizeof(header)), header.num_entry);
+    }
+    if (err == ESP_OK) {
+        const uint8_t *ref_array = payload + sizeof(header) + header.num_entry * sizeof(IRMP_DATA);
+        for (int i = 0; i < header.num_remote; i++) {
+            memcpy(s_ir_code_tv_ref_array[i], ref_array + i * header.num_code, header.num_code);
+            ir_retain_tv(i);
+        }
+        if (header.num_remote < IR_TV_NUM_REMOTE || header.num_code < IR_TV_NUM_CODE) {
+            record_count_migrated();
+            *is_rewrite = 1;
+        }
+    }
+    free(payload);
+    return err;
+}
+
+// Unversioned keys and the separate pool and reference records are only dropped once their content is safely
+// in the combined record
+static void ir_erase_legacy(void)
+{
+    nvs_erase_key(s_ir_handle, IR_POOL_KEY);
+    record_erase(s_ir_handle, IR_POOL_KEY);
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        nvs_erase_key(s_ir_handle, s_ir_tv_key_name_array[i]);
+        record_erase(s_ir_handle, s_ir_tv_key_name_array[i]);
+        nvs_erase_key(s_iri_handle, s_ir_tv_key_name_array[i]);
+    }
+    nvs_commit(s_ir_handle);
+    nvs_commit(s_iri_handle);
+}
+
+// A record damaged in both slots leaves its remotes empty instead of stopping the boot. Records written by a
+// newer firmware are left as they are and nothing is saved until that firmware is back
 esp_err_t ir_storage_init(void)
 {
     esp_err_t err;
-    size_t ir_code_array_size = 0;
-    ESP_ERROR_CHECK(nvs_open(IR_NAMESPACE, NVS_READWRITE, &s_ir_handle));
-    ESP_ERROR_CHECK(nvs_open(IRI_NAMESPACE, NVS_READWRITE, &s_iri_handle));
-    
+    uint8_t is_rewrite = 0;
+    err = nvs_open(IR_NAMESPACE, NVS_READWRITE, &s_ir_handle);
+    if (err != ESP_OK) return err;
+    err = nvs_open(IRI_NAMESPACE, NVS_READWRITE, &s_iri_handle);
+    if (err != ESP_OK) return err;
+    err = ir_load_codes(&is_rewrite);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ir_load_legacy_codes(&is_rewrite);
+    }
+    if (err == ESP_ERR_NO_MEM) return err;
+    if (err == ESP_ERR_INVALID_VERSION) {
+        s_ir_is_read_only = 1;
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "IR codes lost: %s", esp_err_to_name(err));
+        is_rewrite = 1;
+    }
+
     for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
-        ir_code_array_size = 0;
-        err = nvs_get_blob(s_ir_handle, s_ir_tv_key_name_array[i], NULL, &ir_code_array_size);
-        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
-        if (ir_code_array_size == 0) {
-            ESP_LOGI(TAG, "Empty IR code detected in TV remote %d", i + 1);
-        } else {
-            ESP_ERROR_CHECK(nvs_get_blob(s_ir_handle, s_ir_tv_key_name_array[i], s_ir_code_tv_array[i], &ir_code_array_size));
-        }
-        
-        ir_code_array_size = 0;
-        err = nvs_get_str(s_iri_handle, s_ir_tv_key_name_array[i], NULL, &ir_code_array_size);
-        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
-        if (ir_code_array_size == 0) {
-            ESP_LOGI(TAG, "Empty IR information detected in TV remote %d", i + 1);
-        } else {
-            ESP_ERROR_CHECK(nvs_get_str(s_ir_handle, s_ir_tv_key_name_array[i], s_ir_code_tv_info_array[i], &ir_code_array_size));
+        err = ir_load_info_tv(i, &is_rewrite);
+        if (err == ESP_ERR_INVALID_VERSION) {
+            s_ir_is_read_only = 1;
+        } else if (err != ESP_OK) {
+            ESP_LOGE(TAG, "IR information of TV remote %d lost: %s", i + 1, esp_err_to_name(err));
+            is_rewrite = 1;
         }
     }
+    ir_pool_collect();
+
+    if (s_ir_is_read_only) {
+        ESP_LOGE(TAG, "IR storage was written by a newer firmware, it is left untouched and changes are not saved");
+        return ESP_OK;
+    }
+    if (is_rewrite) {
+        ESP_LOGI(TAG, "Rewriting IR storage");
+        err = ir_commit_all_tv();
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to rewrite IR storage: %s", esp_err_to_name(err));
+            return ESP_OK;
+        }
+    }
+    ir_erase_legacy();
     return ESP_OK;
 }
 
@@ -118,7 +412,16 @@ esp_err_t ir_add_code_tv(IRMP_DATA ir_code, uint8_t ir_code_id, uint8_t ir_remot
 {
     if (ir_remote_id >= IR_TV_NUM_REMOTE) return ESP_FAIL;
     if (ir_code_id >= IR_TV_NUM_CODE) return ESP_FAIL;
-    s_ir_code_tv_array[ir_remote_id][ir_code_id] = ir_code;
+    uint8_t ir_ref;
+    IRMP_DATA ir_old_code;
+    if (ir_pool_intern(&ir_code, &ir_ref) != ESP_OK)
+        return ESP_ERR_NO_MEM;
+    if (ir_ref != s_ir_code_tv_ref_array[ir_remote_id][ir_code_id]) {
+        ir_pool_get(s_ir_code_tv_ref_array[ir_remote_id][ir_code_id], &ir_old_code);
+        ir_cache_invalidate(&ir_old_code);
+    }
+    ir_pool_release(s_ir_code_tv_ref_array[ir_remote_id][ir_code_id]);
+    s_ir_code_tv_ref_array[ir_remote_id][ir_code_id] = ir_ref;
     return ESP_OK;
 }
 
@@ -129,15 +432,113 @@ esp_err_t ir_add_code_info_tv(char *info, uint8_t ir_remote_id)
     return ESP_OK;
 }
 
+// Pool and references share one record, so falling back to its older slot never pairs references with another pool
+static esp_err_t ir_write_codes(void)
+{
+    uint8_t *payload = malloc(IR_CODES_MAX_LEN);
+    if (payload == NULL)
+        return ESP_ERR_NO_MEM;
+    ir_codes_header_t header = {
+        .num_remote = IR_TV_NUM_REMOTE,
+        .num_code = IR_TV_NUM_CODE,
+        .num_entry = ir_pool_copy((IRMP_DATA *) (payload + sizeof(ir_codes_header_t))),
+    };
+    size_t length = sizeof(header) + header.num_entry * sizeof(IRMP_DATA);
+    memcpy(payload, &header, sizeof(header));
+    memcpy(payload + length, s_ir_code_tv_ref_array, sizeof(s_ir_code_tv_ref_array));
+    length += sizeof(s_ir_code_tv_ref_array);
+    esp_err_t err = record_write(s_ir_handle, IR_CODES_KEY, IR_CODES_RECORD_VERSION, payload, length);
+    free(payload);
+    return err;
+}
+
+static esp_err_t ir_write_info_tv(uint8_t ir_remote_id)
+{
+    const char *info = s_ir_code_tv_info_array[ir_remote_id];
+    return record_write(s_iri_handle, s_ir_tv_key_name_array[ir_remote_id], IR_INFO_RECORD_VERSION, info, strnlen(info, IR_INFO_LEN - 1) + 1);
+}
+
 esp_err_t ir_commit_tv(uint8_t ir_remote_id)
 {
     if (ir_remote_id >= IR_TV_NUM_REMOTE) return ESP_FAIL;
-    if (nvs_set_blob(s_ir_handle, s_ir_tv_key_name_array[ir_remote_id], s_ir_code_tv_array[ir_remote_id], sizeof(IRMP_DATA) * IR_TV_NUM_CODE) != ESP_OK) 
+    if (s_ir_is_read_only) return ESP_ERR_INVALID_VERSION;
+    if (ir_write_codes() != ESP_OK)
         return ESP_FAIL;
-    if (nvs_set_str(s_ir_handle, s_ir_tv_key_name_array[ir_remote_id], s_ir_code_tv_info_array[ir_remote_id]) != ESP_OK)
+    if (ir_write_info_tv(ir_remote_id) != ESP_OK)
         return ESP_FAIL;
-    ESP_ERROR_CHECK(nvs_commit(s_ir_handle));
-    return ESP_OK;
+    esp_err_t err = nvs_commit(s_ir_handle);
+    if (err != ESP_OK)
+        return err;
+    return nvs_commit(s_iri_handle);
+}
+
+esp_err_t ir_commit_all_tv(void)
+{
+    if (s_ir_is_read_only) return ESP_ERR_INVALID_VERSION;
+    if (ir_write_codes() != ESP_OK)
+        return ESP_FAIL;
+    for (int i = 0; i < IR_TV_NUM_REMOTE; i++) {
+        if (ir_write_info_tv(i) != ESP_OK)
+            return ESP_FAIL;
+    }
+    esp_err_t err = nvs_commit(s_ir_handle);
+    if (err != ESP_OK)
+        return err;
+    return nvs_commit(s_iri_handle);
+}
+
+esp_err_t ir_get_code_tv(uint8_t ir_code_id, uint8_t ir_remote_id, IRMP_DATA *ir_code)
+{
+    if (ir_remote_id >= IR_TV_NUM_REMOTE) return ESP_FAIL;
+    if (ir_code_id >= IR_TV_NUM_CODE) return ESP_FAIL;
+    return ir_pool_get(s_ir_code_tv_ref_array[ir_remote_id][ir_code_id], ir_code);
+}
+
+const char *ir_get_code_info_tv(uint8_t ir_remote_id)
+{
+    if (ir_remote_id >= IR_TV_NUM_REMOTE) return NULL;
+    return s_ir_code_tv_info_array[ir_remote_id];
+}
+
+uint32_t ir_get_hash_tv(uint8_t ir_remote_id)
+{
+    if (ir_remote_id >= IR_TV_NUM_REMOTE) return 0;
+    // Hash the codes rather than the pool references, which differ between units
+    IRMP_DATA ir_code;
+    uint32_t crc = 0;
+    for (int i = 0; i < IR_TV_NUM_CODE; i++) {
+        ir_pool_get(s_ir_code_tv_ref_array[ir_remote_id][i], &ir_code);
+        crc = esp_rom_crc32_le(crc, (const uint8_t *) &ir_code, sizeof(IRMP_DATA));
+    }
+    return esp_rom_crc32_le(crc, (const uint8_t *) s_ir_code_tv_info_array[ir_remote_id], strnlen(s_ir_code_tv_info_array[ir_remote_id], IR_INFO_LEN));
+}
+
+uint8_t ir_is_learned_tv(uint8_t ir_code_id, uint8_t ir_remote_id)
+{
+    if (ir_remote_id >= IR_TV_NUM_REMOTE || ir_code_id >= IR_TV_NUM_CODE) return 0;
+    return s_ir_code_tv_ref_array[ir_remote_id][ir_code_id] != 0;
+}
+
+// Takes ir_mutex once neither IRSND nor the cached frame channel is sending. Senders give the lock back while their
+// frame still goes out, so the previous frame is waited for without holding it
+esp_err_t ir_tx_take(void)
+{
+    TickType_t start_tick = xTaskGetTickCount();
+    while (1)
+    {
+        ir_cache_wait_idle();
+        while (irsnd_is_busy() && (xTaskGetTickCount() - start_tick) < pdMS_TO_TICKS(IR_TX_IDLE_TIMEOUT_MS))
+        {
+            vTaskDelay(1);
+        }
+        if (xSemaphoreTake(ir_mutex, 10 / portTICK_PERIOD_MS) != pdTRUE)
+            return ESP_ERR_TIMEOUT;
+        if (!irsnd_is_busy() && !ir_cache_is_sending())
+            return ESP_OK;
+        xSemaphoreGive(ir_mutex);
+        if ((xTaskGetTickCount() - start_tick) >= pdMS_TO_TICKS(IR_TX_IDLE_TIMEOUT_MS))
+            return ESP_ERR_TIMEOUT;
+    }
 }
 
 esp_err_t ir_send_code_tv(long ir_code_id, long ir_remote_id)
@@ -150,15 +551,40 @@ esp_err_t ir_send_code_tv(long ir_code_id, long ir_remote_id)
         ESP_LOGE(TAG, "Invalid ir remote id");
         return ESP_FAIL;
     }
-    IRMP_DATA ir_to_send = s_ir_code_tv_array[ir_remote_id][ir_code_id];
+    IRMP_DATA ir_to_send;
+    ir_pool_get(s_ir_code_tv_ref_array[ir_remote_id][ir_code_id], &ir_to_send);
     if (ir_to_send.address == 0 && ir_to_send.command == 0 && ir_to_send.flags == 0 && ir_to_send.protocol == 0) {
         ESP_LOGE(TAG, "IR code not existed");
         return ESP_FAIL;
     }
-    if (xSemaphoreTake(ir_mutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+    if (ir_tx_take() == ESP_OK) {
         ESP_LOGI(TAG, ">Sent IR: %x %x %x %x\n", ir_to_send.protocol, ir_to_send.address, ir_to_send.command, ir_to_send.flags);
-        irsnd_send_data (&ir_to_send, TRUE);
+        // Learning owns the receiver, frames sent meanwhile are not verified
+        uint8_t is_verify = ir_verify_is_enabled() && uxSemaphoreGetCount(ir_send_semp);
+        if (is_verify) {
+            ir_verify_collect();
+        }
+        int64_t sent_us = esp_timer_get_time();
+        uint8_t is_captured = 0;
+        uint8_t is_jitter_frame = 0;
+        // Jitter runs measure the timer driven path, a cache hit is timed by the RMT hardware. Both paths only
+        // start the frame, it is sent while ir_mutex is free again
+        if (ir_jitter_is_active() || ir_cache_send(&ir_to_send) != ESP_OK) {
+            is_captured = ir_cache_capture_begin(&ir_to_send);
+            is_jitter_frame = ir_jitter_frame_begin();
+            irsnd_send_data (&ir_to_send, TRUE);
+        }
+        if (is_verify) {
+            ir_verify_submit(&ir_to_send, sent_us);
+        }
         xSemaphoreGive(ir_mutex);
+        // The timer callback closes both when IRSND goes idle, a frame of the next sender is never mixed in
+        if (is_captured) {
+            ir_cache_capture_end();
+        }
+        if (is_jitter_frame) {
+            ir_jitter_frame_end();
+        }
     } else {
         ESP_LOGE(TAG, "Failed to obtain ir_mutex");
         return ESP_FAIL;
@@ -166,6 +592,49 @@ esp_err_t ir_send_code_tv(long ir_code_id, long ir_remote_id)
     return ESP_OK;
 }
 
+// Never blocks the caller, the send runs on the IR TX task and done_cb reports the result
+esp_err_t ir_send_code_tv_async(long ir_code_id, long ir_remote_id, ir_tx_source_t source, ir_tx_done_cb_t done_cb, void *ctx)
+{
+    if (ir_code_id < 0 || ir_code_id >= IR_TV_NUM_CODE || ir_remote_id < 0 || ir_remote_id >= IR_TV_NUM_REMOTE || source >= IR_TX_NUM_SOURCE)
+        return ESP_ERR_INVALID_ARG;
+    if (s_ir_tx_queue == NULL)
+        return ESP_ERR_INVALID_STATE;
+    uint8_t is_reserved = 0;
+    taskENTER_CRITICAL(&s_ir_tx_lock);
+    if (s_ir_tx_inflight_array[source] < s_ir_tx_slot_array[source]) {
+        s_ir_tx_inflight_array[source]++;
+        is_reserved = 1;
+    }
+    taskEXIT_CRITICAL(&s_ir_tx_lock);
+    if (!is_reserved)
+        return ESP_ERR_NO_MEM;
+    ir_tx_request_t request = {
+        .ir_code_id = ir_code_id,
+        .ir_remote_id = ir_remote_id,
+        .source = source,
+        .queued_us = esp_timer_get_time(),
+        .done_cb = done_cb,
+        .ctx = ctx,
+    };
+    if (xQueueSend(s_ir_tx_queue, &request, 0) != pdTRUE) {
+        taskENTER_CRITICAL(&s_ir_tx_lock);
+        s_ir_tx_inflight_array[source]--;
+        taskEXIT_CRITICAL(&s_ir_tx_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+UBaseType_t ir_get_tx_queue_depth(void)
+{
+    return s_ir_tx_queue ? uxQueueMessagesWaiting(s_ir_tx_queue) : 0;
+}
+
+uint8_t ir_get_tx_inflight(ir_tx_source_t source)
+{
+    return source < IR_TX_NUM_SOURCE ? s_ir_tx_inflight_array[source] : 0;
+}
+
 esp_err_t ir_add_code_tv_detect(long ir_code_id, long ir_remote_id)
 {    
     if (ir_code_id < 0 || ir_code_id >= IR_TV_NUM_CODE) {
@@ -176,7 +645,17 @@ esp_err_t ir_add_code_tv_detect(long ir_code_id, long ir_remote_id)
         ESP_LOGE(TAG, "Invalid ir remote id");
         return ESP_FAIL;
     }
+    if (s_ir_receive_task_handle == NULL)
+        return ESP_ERR_INVALID_STATE;
     if (xSemaphoreTake(ir_send_semp, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+        // Sends from here on skip verification, a frame still awaiting its loopback decode is settled first
+        if (xSemaphoreTake(ir_mutex, 1000 / portTICK_PERIOD_MS) != pdTRUE) {
+            xSemaphoreGive(ir_send_semp);
+            ESP_LOGE(TAG, "Failed to obtain ir_mutex");
+            return ESP_FAIL;
+        }
+        ir_verify_cancel();
+        xSemaphoreGive(ir_mutex);
         s_ir_code_id = ir_code_id;
         s_ir_remote_id = ir_remote_id;
         xTaskNotifyGive(s_ir_receive_task_handle);
@@ -185,4 +664,9 @@ esp_err_t ir_add_code_tv_detect(long ir_code_id, long ir_remote_id)
         return ESP_FAIL;
     }
     return ESP_OK;
+}
+
+void ir_set_learn_done_cb(ir_learn_done_cb_t done_cb)
+{
+    s_ir_learn_done_cb = done_cb;
 }
\ No newline at end of file
@@ -8,66 +8,97 @@
 
 #define IR_PERIOD_US                (1000000 / F_INTERRUPTS)
 #define IR_RECEIVE_PERIOD_MS        5000
+#define IR_TX_QUEUE_LEN             8
+// TX queue slots reserved for web requests, the rest belong to the other senders so neither can starve the other
+#define IR_TX_WEB_SLOTS             (IR_TX_QUEUE_LEN / 2)
+// The receive task stores learned codes (record write and two NVS commits) and runs the learn-done hook, check the
+// headroom with the `mem` report after a learn when changing this
+#define IR_RECEIVE_STACK_SIZE       4096
+#define IR_TX_STACK_SIZE            3072
+#define IR_TX_IDLE_TIMEOUT_MS       1000
 
 #define IR_NAMESPACE                "ir_storage"
 #define IRI_NAMESPACE               "ir_info_storage"
+#define IR_CODES_KEY                "ir_codes"
+#define IR_POOL_KEY                 "ir_pool"
 #define IR_TV_1                     "ir_tv_1"
 #define IR_TV_2                     "ir_tv_2"
 #define IR_TV_3                     "ir_tv_3"
 #define IR_TV_4                     "ir_tv_4"
 #define IR_TV_5                     "ir_tv_5"
 #define IR_TV_NUM_REMOTE            5
-#define IR_TV_NUM_CODE              44
 #define IR_INFO_LEN                 255
+#define IR_CODES_RECORD_VERSION     1
+// Per remote reference records of older firmware, only read to convert them
+#define IR_TV_RECORD_VERSION        1
+#define IR_INFO_RECORD_VERSION      1
+
+// Single source of the TV keys: IR_TV_CODE_* ids, key names in ir_key.c and the web UI keypad all come from here.
+// Each entry is X(name, label, style, grid), the page draws a btn-bd-<style> button in keypad grid <grid> in table order
+#define IR_TV_KEY_TABLE(X) \
+    X(ON, "ON", special, power)     \
+    X(SOURCE, "SOURCE", num, power) \
+    X(1, "1", num, pad)             \
+    X(2, "2", num, pad)             \
+    X(3, "3", num, pad)             \
+    X(4, "4", num, pad)             \
+    X(5, "5", num, pad)             \
+    X(6, "6", num, pad)             \
+    X(7, "7", num, pad)             \
+    X(8, "8", num, pad)             \
+    X(9, "9", num, pad)             \
+    X(DOT, ".", num, pad)           \
+    X(0, "0", num, pad)             \
+    X(PRE, "PRE-CH", num, pad)      \
+    X(INCREASE, "+", control, pad)  \
+    X(MUTE, "MUTE", num, pad)       \
+    X(CH_UP, "CH+", control, pad)   \
+    X(DECREASE, "-", control, pad)  \
+    X(LIST, "LIST", num, pad)       \
+    X(CH_DOWN, "CH-", control, pad) \
+    X(BRAND1, "BRAND1", brand, pad) \
+    X(HOME, "HOME", num, pad)       \
+    X(BRAND2, "BRAND2", brand, pad) \
+    X(BRAND3, "BRAND3", brand, pad) \
+    X(UP, "UP", control, pad)       \
+    X(GUIDE, "GUIDE", num, pad)     \
+    X(LEFT, "LEFT", control, pad)   \
+    X(ENTER, "ENTER", control, pad) \
+    X(RIGHT, "RIGHT", control, pad) \
+    X(RETURN, "RETURN", num, pad)   \
+    X(DOWN, "DOWN", control, pad)   \
+    X(EXIT, "EXIT", num, pad)       \
+    X(A, "A", special, media)       \
+    X(B, "B", brand, media)         \
+    X(C, "C", control, media)       \
+    X(D, "D", num, media)           \
+    X(SETTINGS, "SETS", num, media) \
+    X(INFO, "INFO", num, media)     \
+    X(CC, "CC", num, media)         \
+    X(STOP, "[]", num, media)       \
+    X(PREVIOUS, "<<", num, media)   \
+    X(RESUME, ">", num, media)      \
+    X(PAUSE, "||", num, media)      \
+    X(NEXT, ">>", num, media)
+
+#define IR_TV_KEY_ENUM(name, label, style, grid)    IR_TV_CODE_##name,
 
 enum {
-    IR_TV_CODE_ON,
-    IR_TV_CODE_SOURCE,
-    IR_TV_CODE_1,
-    IR_TV_CODE_2,
-    IR_TV_CODE_3,
-    IR_TV_CODE_4,
-    IR_TV_CODE_5,
-    IR_TV_CODE_6,
-    IR_TV_CODE_7,
-    IR_TV_CODE_8,
-    IR_TV_CODE_9,
-    IR_TV_CODE_DOT,
-    IR_TV_CODE_0,
-    IR_TV_CODE_PRE,
-    IR_TV_CODE_INCREASE,
-    IR_TV_CODE_MUTE,
-    IR_TV_CODE_CH_UP,
-    IR_TV_CODE_DECREASE,
-    IR_TV_CODE_LIST,
-    IR_TV_CODE_CH_DOWN,
-    IR_TV_CODE_BRAND1,
-    IR_TV_CODE_HOME,
-    IR_TV_CODE_BRAND2,
-    IR_TV_CODE_BRAND3,
-    IR_TV_CODE_UP,
-    IR_TV_CODE_GUIDE,
-    IR_TV_CODE_LEFT,
-    IR_TV_CODE_ENTER,
-    IR_TV_CODE_RIGHT,
-    IR_TV_CODE_RETURN,
-    IR_TV_CODE_DOWN,
-    IR_TV_CODE_EXIT,
-    IR_TV_CODE_A,
-    IR_TV_CODE_B,
-    IR_TV_CODE_C,
-    IR_TV_CODE_D,
-    IR_TV_CODE_SETTINGS,
-    IR_TV_CODE_INFO,
-    IR_TV_CODE_CC,
-    IR_TV_CODE_STOP,
-    IR_TV_CODE_PREVIOUS,
-    IR_TV_CODE_RESUME,
-    IR_TV_CODE_PAUSE,
-    IR_TV_CODE_NEXT,
+    IR_TV_KEY_TABLE(IR_TV_KEY_ENUM)
+    IR_TV_NUM_CODE
 };
 
 
+typedef enum {
+    IR_TX_SOURCE_WEB,
+    IR_TX_SOURCE_OTHER,         // MQTT, the scheduler and the soak harness
+    IR_TX_NUM_SOURCE,
+} ir_tx_source_t;
+
+// Called from the IR TX task once a queued send finished, keep it short
+typedef void (*ir_tx_done_cb_t)(uint8_t ir_code_id, uint8_t ir_remote_id, esp_err_t err, int64_t queued_us, void *ctx);
+typedef void (*ir_learn_done_cb_t)(uint8_t ir_code_id, uint8_t ir_remote_id, esp_err_t err);
+
 extern QueueHandle_t ir_mutex;
 extern IRMP_DATA irmp_data;
 
@@ -80,8 +111,18 @@ esp_err_t ir_storage_init(void);
 esp_err_t ir_add_code_tv(IRMP_DATA ir_code, uint8_t ir_code_id, uint8_t ir_remote_id);
 esp_err_t ir_add_code_info_tv(char *info, uint8_t ir_remote_id);
 esp_err_t ir_commit_tv(uint8_t ir_remote_id);
+esp_err_t ir_commit_all_tv(void);
+esp_err_t ir_get_code_tv(uint8_t ir_code_id, uint8_t ir_remote_id, IRMP_DATA *ir_code);
+const char *ir_get_code_info_tv(uint8_t ir_remote_id);
+uint32_t ir_get_hash_tv(uint8_t ir_remote_id);
+uint8_t ir_is_learned_tv(uint8_t ir_code_id, uint8_t ir_remote_id);
+esp_err_t ir_tx_take(void);
 esp_err_t ir_send_code_tv(long ir_code_id, long ir_remote_id);
+esp_err_t ir_send_code_tv_async(long ir_code_id, long ir_remote_id, ir_tx_source_t source, ir_tx_done_cb_t done_cb, void *ctx);
+UBaseType_t ir_get_tx_queue_depth(void);
+uint8_t ir_get_tx_inflight(ir_tx_source_t source);
 esp_err_t ir_add_code_tv_detect(long ir_code_id, long ir_remote_id);
+void ir_set_learn_done_cb(ir_learn_done_cb_t done_cb);
 
 #ifdef __cplusplus
 }
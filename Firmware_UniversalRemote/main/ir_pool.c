@@ -0,0 +1,311 @@
+#include <string.h>
+#include <stdlib.h>
+#include "ir_pool.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mem_budget.h"
+#include "record_store.h"
+
+static const char *TAG = "IR_POOL";
+
+// Free entries are zeroed and not linked in any bucket, entries loaded from NVS stay linked with refcount 0 until collected
+typedef struct {
+    IRMP_DATA code;
+    uint8_t refcount;
+    uint8_t next;
+} ir_pool_entry_t;
+
+static ir_pool_entry_t *s_pool_entry_array;
+static uint16_t s_pool_len;
+static uint16_t s_pool_capacity;
+static uint8_t s_pool_bucket_array[IR_POOL_HASH_SIZE];
+static SemaphoreHandle_t s_pool_mutex;
+MEM_SEMAPHORE_BUFFER(s_pool_mutex);
+
+static uint8_t ir_pool_is_empty_code(const IRMP_DATA *ir_code)
+{
+    return ir_code->protocol == 0 && ir_code->address == 0 && ir_code->command == 0 && ir_code->flags == 0;
+}
+
+static uint8_t ir_pool_is_same_code(const IRMP_DATA *a, const IRMP_DATA *b)
+{
+    return a->protocol == b->protocol && a->address == b->address && a->command == b->command && a->flags == b->flags;
+}
+
+static uint32_t ir_pool_hash(const IRMP_DATA *ir_code)
+{
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ ir_code->protocol) * 16777619u;
+    hash = (hash ^ (ir_code->address & 0xFF)) * 16777619u;
+    hash = (hash ^ (ir_code->address >> 8)) * 16777619u;
+    hash = (hash ^ (ir_code->command & 0xFF)) * 16777619u;
+    hash = (hash ^ (ir_code->command >> 8)) * 16777619u;
+    hash = (hash ^ ir_code->flags) * 16777619u;
+    return hash % IR_POOL_HASH_SIZE;
+}
+
+static uint8_t ir_pool_find(const IRMP_DATA *ir_code)
+{
+    for (uint8_t ref = s_pool_bucket_array[ir_pool_hash(ir_code)]; ref != 0; ref = s_pool_entry_array[ref - 1].next) {
+        if (ir_pool_is_same_code(&s_pool_entry_array[ref - 1].code, ir_code)) {
+            return ref;
+        }
+    }
+    return 0;
+}
+
+static void ir_pool_link(uint8_t ir_ref)
+{
+    uint32_t bucket = ir_pool_hash(&s_pool_entry_array[ir_ref - 1].code);
+    s_pool_entry_array[ir_ref - 1].next = s_pool_bucket_array[bucket];
+    s_pool_bucket_array[bucket] = ir_ref;
+}
+
+static void ir_pool_unlink(uint8_t ir_ref)
+{
+    ir_pool_entry_t *entry = &s_pool_entry_array[ir_ref - 1];
+    uint8_t *link = &s_pool_bucket_array[ir_pool_hash(&entry->code)];
+    while (*link != 0 && *link != ir_ref)
+    {
+        link = &s_pool_entry_array[*link - 1].next;
+    }
+    if (*link == ir_ref) {
+        *link = entry->next;
+    }
+    memset(entry, 0, sizeof(ir_pool_entry_t));
+}
+
+static esp_err_t ir_pool_reserve(uint16_t capacity)
+{
+    if (capacity <= s_pool_capacity)
+        return ESP_OK;
+    capacity = (capacity + IR_POOL_GROW_ENTRY - 1) / IR_POOL_GROW_ENTRY * IR_POOL_GROW_ENTRY;
+    if (capacity > IR_POOL_MAX_ENTRY)
+        capacity = IR_POOL_MAX_ENTRY;
+    ir_pool_entry_t *entry_array = realloc(s_pool_entry_array, capacity * sizeof(ir_pool_entry_t));
+    if (entry_array == NULL)
+        return ESP_ERR_NO_MEM;
+    memset(entry_array + s_pool_capacity, 0, (capacity - s_pool_capacity) * sizeof(ir_pool_entry_t));
+    s_pool_entry_array = entry_array;
+    s_pool_capacity = capacity;
+    return ESP_OK;
+}
+
+esp_err_t ir_pool_init(void)
+{
+    s_pool_mutex = mem_mutex_create(MEM_SEMAPHORE(s_pool_mutex));
+    if (s_pool_mutex == NULL)
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+esp_err_t ir_pool_intern(const IRMP_DATA *ir_code, uint8_t *ir_ref)
+{
+    if (ir_pool_is_empty_code(ir_code)) {
+        *ir_ref = 0;
+        return ESP_OK;
+    }
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    uint8_t ref = ir_pool_find(ir_code);
+    if (ref == 0) {
+        for (uint16_t i = 0; i < s_pool_len; i++) {
+            if (s_pool_entry_array[i].refcount == 0 && ir_pool_is_empty_code(&s_pool_entry_array[i].code)) {
+                ref = i + 1;
+                break;
+            }
+        }
+        if (ref == 0) {
+            if (s_pool_len >= IR_POOL_MAX_ENTRY) {
+                err = ESP_ERR_NO_MEM;
+            } else {
+                err = ir_pool_reserve(s_pool_len + 1);
+            }
+            if (err == ESP_OK) {
+                ref = ++s_pool_len;
+            }
+        }
+        if (ref != 0) {
+            s_pool_entry_array[ref - 1].code = *ir_code;
+            ir_pool_link(ref);
+        }
+    }
+    if (ref != 0) {
+        s_pool_entry_array[ref - 1].refcount++;
+    }
+    xSemaphoreGive(s_pool_mutex);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Code pool full");
+    }
+    *ir_ref = ref;
+    return err;
+}
+
+void ir_pool_retain(uint8_t ir_ref)
+{
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    if (ir_ref != 0 && ir_ref <= s_pool_len) {
+        s_pool_entry_array[ir_ref - 1].refcount++;
+    }
+    xSemaphoreGive(s_pool_mutex);
+}
+
+void ir_pool_release(uint8_t ir_ref)
+{
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    if (ir_ref != 0 && ir_ref <= s_pool_len && s_pool_entry_array[ir_ref - 1].refcount > 0) {
+        if (--s_pool_entry_array[ir_ref - 1].refcount == 0) {
+            ir_pool_unlink(ir_ref);
+        }
+    }
+    xSemaphoreGive(s_pool_mutex);
+}
+
+esp_err_t ir_pool_get(uint8_t ir_ref, IRMP_DATA *ir_code)
+{
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    if (ir_ref == 0) {
+        memset(ir_code, 0, sizeof(IRMP_DATA));
+    } else if (ir_ref <= s_pool_len) {
+        *ir_code = s_pool_entry_array[ir_ref - 1].code;
+    } else {
+        err = ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreGive(s_pool_mutex);
+    return err;
+}
+
+uint8_t ir_pool_is_valid(uint8_t ir_ref)
+{
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    uint8_t is_valid = ir_ref <= s_pool_len && (ir_ref == 0 || !ir_pool_is_empty_code(&s_pool_entry_array[ir_ref - 1].code));
+    xSemaphoreGive(s_pool_mutex);
+    return is_valid;
+}
+
+// Drop entries loaded from NVS that no remote references anymore
+void ir_pool_collect(void)
+{
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    for (uint16_t i = 0; i < s_pool_len; i++) {
+        if (s_pool_entry_array[i].refcount == 0 && !ir_pool_is_empty_code(&s_pool_entry_array[i].code)) {
+            ir_pool_unlink(i + 1);
+        }
+    }
+    while (s_pool_len > 0 && s_pool_entry_array[s_pool_len - 1].refcount == 0)
+    {
+        s_pool_len--;
+    }
+    xSemaphoreGive(s_pool_mutex);
+}
+
+// Replaces the whole pool, entries stay linked with refcount 0 until the remotes retain them or they are collected
+esp_err_t ir_pool_set(const IRMP_DATA *code_array, uint16_t num_entry)
+{
+    if (num_entry > IR_POOL_MAX_ENTRY)
+        return ESP_ERR_INVALID_SIZE;
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    esp_err_t err = ir_pool_reserve(num_entry);
+    if (err == ESP_OK) {
+        memset(s_pool_bucket_array, 0, sizeof(s_pool_bucket_array));
+        memset(s_pool_entry_array, 0, s_pool_capacity * sizeof(ir_pool_entry_t));
+        s_pool_len = num_entry;
+        for (uint16_t i = 0; i < num_entry; i++) {
+            s_pool_entry_array[i].code = code_array[i];
+            if (!ir_pool_is_empty_code(&code_array[i])) {
+                ir_pool_link(i + 1);
+            }
+        }
+    }
+    xSemaphoreGive(s_pool_mutex);
+    return err;
+}
+
+// code_array holds IR_POOL_MAX_ENTRY codes, returns the number copied
+uint16_t ir_pool_copy(IRMP_DATA *code_array)
+{
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    uint16_t num_entry = s_pool_len;
+    for (uint16_t i = 0; i < num_entry; i++) {
+        code_array[i] = s_pool_entry_array[i].code;
+    }
+    xSemaphoreGive(s_pool_mutex);
+    return num_entry;
+}
+
+// Pool stored on its own by older firmware, either as a record or as the unversioned blob written before records
+esp_err_t ir_pool_load_legacy(nvs_handle_t handle, const char *key)
+{
+    size_t length = IR_POOL_MAX_ENTRY * sizeof(IRMP_DATA);
+    uint16_t version = IR_POOL_RECORD_VERSION;
+    IRMP_DATA *code_array = malloc(length);
+    if (code_array == NULL)
+        return ESP_ERR_NO_MEM;
+    esp_err_t err = record_read(handle, key, code_array, &length, &version);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = nvs_get_blob(handle, key, code_array, &length);
+    }
+    if (err == ESP_OK && version != IR_POOL_RECORD_VERSION) {
+        ESP_LOGE(TAG, "Unknown code pool version %d", version);
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    if (err == ESP_OK && length % sizeof(IRMP_DATA) != 0) {
+        ESP_LOGE(TAG, "Invalid code pool size %d", (int) length);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK) {
+        err = ir_pool_set(code_array, length / sizeof(IRMP_DATA));
+    }
+    free(code_array);
+    return err;
+}
+
+esp_err_t ir_pool_get_stats(ir_pool_stats_t *stats)
+{
+    memset(stats, 0, sizeof(ir_pool_stats_t));
+    xSemaphoreTake(s_pool_mutex, portMAX_DELAY);
+    for (uint16_t i = 0; i < s_pool_len; i++) {
+        if (s_pool_entry_array[i].refcount > 0) {
+            stats->num_entry++;
+            stats->num_ref += s_pool_entry_array[i].refcount;
+        }
+    }
+    stats->capacity = s_pool_capacity;
+    stats->ram_bytes = s_pool_capacity * sizeof(ir_pool_entry_t) + sizeof(s_pool_bucket_array);
+    stats->nvs_bytes = s_pool_len * sizeof(IRMP_DATA);
+
+    // Lookup cost, every live entry is looked up by value and by reference in turn
+    if (stats->num_entry > 0) {
+        volatile uint8_t sink = 0;
+        uint16_t index = 0;
+        int64_t start_us = esp_timer_get_time();
+        for (uint32_t n = 0; n < IR_POOL_BENCH_ITERATION; n++) {
+            while (s_pool_entry_array[index].refcount == 0)
+            {
+                index = (index + 1) % s_pool_len;
+            }
+            sink += ir_pool_find(&s_pool_entry_array[index].code);
+            index = (index + 1) % s_pool_len;
+        }
+        stats->find_ns = (esp_timer_get_time() - start_us) * 1000 / IR_POOL_BENCH_ITERATION;
+        (void) sink;
+    }
+    uint16_t pool_len = s_pool_len;
+    xSemaphoreGive(s_pool_mutex);
+
+    // ir_pool_get takes the mutex itself, timed the way a send looks a code up
+    if (stats->num_entry > 0) {
+        IRMP_DATA ir_code;
+        int64_t start_us = esp_timer_get_time();
+        for (uint32_t n = 0; n < IR_POOL_BENCH_ITERATION; n++) {
+            ir_pool_get(n % pool_len + 1, &ir_code);
+        }
+        stats->get_ns = (esp_timer_get_time() - start_us) * 1000 / IR_POOL_BENCH_ITERATION;
+    }
+    return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef IR_POOL_H
+#define IR_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+#include "irmp.h"
+
+/*
+ * Interned pool of unique IR codes shared by all remotes. Remotes keep a uint8_t reference per key,
+ * 0 means the key is not learned and n refers to pool entry n - 1.
+ */
+#define IR_POOL_MAX_ENTRY           255
+#define IR_POOL_HASH_SIZE           64
+#define IR_POOL_GROW_ENTRY          16
+#define IR_POOL_BENCH_ITERATION     1000
+// Version of the pool record older firmware stored on its own, read by ir_pool_load_legacy
+#define IR_POOL_RECORD_VERSION      1
+
+typedef struct {
+    uint16_t num_entry;
+    uint16_t num_ref;
+    uint16_t capacity;
+    size_t ram_bytes;
+    size_t nvs_bytes;
+    uint32_t find_ns;
+    uint32_t get_ns;
+} ir_pool_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ir_pool_init(void);
+esp_err_t ir_pool_intern(const IRMP_DATA *ir_code, uint8_t *ir_ref);
+void ir_pool_retain(uint8_t ir_ref);
+void ir_pool_release(uint8_t ir_ref);
+esp_err_t ir_pool_get(uint8_t ir_ref, IRMP_DATA *ir_code);
+uint8_t ir_pool_is_valid(uint8_t ir_ref);
+void ir_pool_collect(void);
+esp_err_t ir_pool_set(const IRMP_DATA *code_array, uint16_t num_entry);
+uint16_t ir_pool_copy(IRMP_DATA *code_array);
+esp_err_t ir_pool_load_legacy(nvs_handle_t handle, const char *key);
+esp_err_t ir_pool_get_stats(ir_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
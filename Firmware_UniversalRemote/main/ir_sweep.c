@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include "ir_sweep.h"
+#include "mem_budget.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "pin_config.h"
+
+static const char *TAG = "IR_SWEEP";
+
+#define SWEEP_START_BIT             BIT0
+#define SWEEP_CONFIRM_BIT           BIT1
+#define SWEEP_STOP_BIT              BIT2
+
+typedef struct {
+    const char *brand;
+    uint8_t protocol;
+    uint8_t flags;
+    uint16_t address;
+    uint16_t gap_ms;
+    uint16_t command[IR_SWEEP_NUM_KEY];
+} ir_sweep_code_set_t;
+
+// Keys bound to the remote slot once a code set is confirmed, command[0] is the power code used for the sweep
+static const uint8_t s_sweep_key_array[IR_SWEEP_NUM_KEY] = {
+    IR_TV_CODE_ON, IR_TV_CODE_INCREASE, IR_TV_CODE_DECREASE, IR_TV_CODE_MUTE, IR_TV_CODE_CH_UP, IR_TV_CODE_CH_DOWN,
+};
+
+// Candidate code sets in IRMP representation, gap_ms is the minimum pause before the next frame may start
+static const ir_sweep_code_set_t s_sweep_code_set_array[] = {
+    {"Samsung",     IRMP_SAMSUNG32_PROTOCOL, 0, 0x0707, 47, {0xFD02, 0xF807, 0xF40B, 0xF00F, 0xED12, 0xEF10}},
+    {"LG",          IRMP_NEC_PROTOCOL,       0, 0xFB04, 40, {0x08, 0x02, 0x03, 0x09, 0x00, 0x01}},
+    {"Toshiba",     IRMP_NEC_PROTOCOL,       0, 0xBF40, 40, {0x12, 0x1A, 0x1E, 0x10, 0x1B, 0x1F}},
+    {"Sony",        IRMP_SIRCS_PROTOCOL,     2, 0x0001, 25, {0x15, 0x12, 0x13, 0x14, 0x10, 0x11}},
+    {"Philips RC5", IRMP_RC5_PROTOCOL,       0, 0x0000, 89, {0x0C, 0x10, 0x11, 0x0D, 0x20, 0x21}},
+    {"Philips RC6", IRMP_RC6_PROTOCOL,       0, 0x0000, 90, {0x0C, 0x10, 0x11, 0x0D, 0x4C, 0x4D}},
+};
+
+#define SWEEP_NUM_CODE_SET          (sizeof(s_sweep_code_set_array) / sizeof(s_sweep_code_set_array[0]))
+
+static TaskHandle_t s_ir_sweep_task_handle;
+MEM_TASK_BUFFER(s_ir_sweep_task, IR_SWEEP_STACK_SIZE);
+static volatile uint8_t s_is_sweep_running;
+// Serial, web and key press can all start or end a sweep
+static portMUX_TYPE s_sweep_lock = portMUX_INITIALIZER_UNLOCKED;
+static long s_sweep_remote_id;
+
+static void ir_sweep_encode(IRMP_DATA *frame, int code_set_id, int key_id)
+{
+    const ir_sweep_code_set_t *code_set = &s_sweep_code_set_array[code_set_id];
+    frame->protocol = code_set->protocol;
+    frame->address = code_set->address;
+    frame->command = code_set->command[key_id];
+    frame->flags = code_set->flags;
+}
+
+static uint8_t ir_sweep_is_stopped(void)
+{
+    uint32_t bits = 0;
+    xTaskNotifyWait(0, SWEEP_STOP_BIT, &bits, 0);
+    return (bits & SWEEP_STOP_BIT) != 0;
+}
+
+static void ir_sweep_wait_idle(void)
+{
+    while (irsnd_is_busy())
+    {
+        vTaskDelay(1);
+    }
+}
+
+// Send the power code of every code set in [first, last) back to back. The next frame is prepared while the
+// current one is still being clocked out, so the only dead time between frames is the protocol gap.
+static esp_err_t ir_sweep_transmit(int first, int last)
+{
+    IRMP_DATA frame_array[2];
+    uint16_t gap_ms = 0;
+
+    ir_sweep_encode(&frame_array[0], first, 0);
+    for (int i = first; i < last; i++) {
+        IRMP_DATA *frame = &frame_array[(i - first) & 1];
+        ir_sweep_wait_idle();
+        if (gap_ms) {
+            vTaskDelay(pdMS_TO_TICKS(gap_ms) + 1);
+        }
+        if (ir_sweep_is_stopped()) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (ir_tx_take() != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to obtain ir_mutex");
+            return ESP_FAIL;
+        }
+        if (irsnd_send_data(frame, FALSE)) {
+            gap_ms = s_sweep_code_set_array[i].gap_ms;
+        } else {
+            ESP_LOGW(TAG, "Protocol %d not supported by irsnd, skipping %s", frame->protocol, s_sweep_code_set_array[i].brand);
+            gap_ms = 0;
+        }
+        xSemaphoreGive(ir_mutex);
+        if (i + 1 < last) {
+            ir_sweep_encode(&frame_array[(i + 1 - first) & 1], i + 1, 0);
+        }
+    }
+    ir_sweep_wait_idle();
+    return ESP_OK;
+}
+
+// Any notification wakes the task, only a confirm or stop received within the window ends the wait early and a
+// timeout never reports a confirm
+static esp_err_t ir_sweep_wait_confirm(uint8_t *is_confirmed)
+{
+    TickType_t start_tick = xTaskGetTickCount();
+    TickType_t window_ticks = IR_SWEEP_CONFIRM_WINDOW_MS / portTICK_PERIOD_MS;
+    TickType_t elapsed_ticks;
+    uint32_t bits;
+    *is_confirmed = 0;
+    while ((elapsed_ticks = xTaskGetTickCount() - start_tick) < window_ticks)
+    {
+        bits = 0;
+        if (xTaskNotifyWait(0, SWEEP_CONFIRM_BIT | SWEEP_STOP_BIT, &bits, window_ticks - elapsed_ticks) != pdTRUE)
+            break;
+        if (bits & SWEEP_STOP_BIT) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (bits & SWEEP_CONFIRM_BIT) {
+            *is_confirmed = 1;
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ir_sweep_bind(int code_set_id, long ir_remote_id)
+{
+    IRMP_DATA ir_code;
+    char info[IR_INFO_LEN];
+
+    for (int i = 0; i < IR_SWEEP_NUM_KEY; i++) {
+        ir_sweep_encode(&ir_code, code_set_id, i);
+        ir_add_code_tv(ir_code, s_sweep_key_array[i], ir_remote_id);
+    }
+    snprintf(info, sizeof(info), "%s", s_sweep_code_set_array[code_set_id].brand);
+    ir_add_code_info_tv(info, ir_remote_id);
+    return ir_commit_tv(ir_remote_id);
+}
+
+// Transmit [first, last) once and wait for the user
+static esp_err_t ir_sweep_round(int first, int last, uint8_t *is_confirmed)
+{
+    // Drops a confirm left over from the previous round, a clear on entry would keep it while it is pending
+    ulTaskNotifyValueClear(NULL, SWEEP_CONFIRM_BIT);
+    if (ir_sweep_transmit(first, last) != ESP_OK || ir_sweep_wait_confirm(is_confirmed) != ESP_OK)
+        return ESP_FAIL;
+    return ESP_OK;
+}
+
+// Bisect the candidate list: every round transmits one half and the user confirms if the TV reacted. Bisection
+// assumes a single working code set, so the result is sent alone once more unless a round already did that.
+static esp_err_t ir_sweep_run(long ir_remote_id)
+{
+    int lo = 0;
+    int hi = SWEEP_NUM_CODE_SET;
+    uint8_t is_confirmed = 0;
+    uint8_t is_alone_confirmed = 0;
+
+    ESP_LOGI(TAG, "Sweeping %d code sets for TV remote %ld", hi, ir_remote_id + 1);
+    if (ir_sweep_round(lo, hi, &is_confirmed) != ESP_OK)
+        return ESP_FAIL;
+    if (!is_confirmed) {
+        ESP_LOGW(TAG, "No code set confirmed");
+        return ESP_ERR_NOT_FOUND;
+    }
+    is_alone_confirmed = hi - lo == 1;
+
+    while (hi - lo > 1)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (ir_sweep_round(lo, mid, &is_confirmed) != ESP_OK)
+            return ESP_FAIL;
+        if (is_confirmed) {
+            hi = mid;
+            is_alone_confirmed = hi - lo == 1;
+        } else {
+            lo = mid;
+        }
+    }
+
+    if (!is_alone_confirmed) {
+        if (ir_sweep_round(lo, hi, &is_confirmed) != ESP_OK)
+            return ESP_FAIL;
+        if (!is_confirmed) {
+            ESP_LOGW(TAG, "%s alone was not confirmed, no code set bound", s_sweep_code_set_array[lo].brand);
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+
+    ESP_LOGI(TAG, "Matched %s, binding to TV remote %ld", s_sweep_code_set_array[lo].brand, ir_remote_id + 1);
+    return ir_sweep_bind(lo, ir_remote_id);
+}
+
+void ir_sweep_task(void *args)
+{
+    uint32_t bits = 0;
+    while (1)
+    {
+        xTaskNotifyWait(0, SWEEP_START_BIT | SWEEP_STOP_BIT, &bits, portMAX_DELAY);
+        if (!(bits & SWEEP_START_BIT)) {
+            continue;
+        }
+        gpio_set_level(LED_PIN, 0);
+        ir_sweep_run(s_sweep_remote_id);
+        gpio_set_level(LED_PIN, 1);
+        taskENTER_CRITICAL(&s_sweep_lock);
+        s_is_sweep_running = 0;
+        taskEXIT_CRITICAL(&s_sweep_lock);
+    }
+}
+
+esp_err_t ir_sweep_init(void)
+{
+    if (mem_task_create(&ir_sweep_task, "IR_SWEEP_TASK", IR_SWEEP_STACK_SIZE, NULL, 2, &s_ir_sweep_task_handle, 1,
+                        MEM_TASK_STACK(s_ir_sweep_task), MEM_TASK_TCB(s_ir_sweep_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+esp_err_t ir_sweep_start_tv(long ir_remote_id)
+{
+    if (ir_remote_id < 0 || ir_remote_id >= IR_TV_NUM_REMOTE) {
+        ESP_LOGE(TAG, "Invalid ir remote id");
+        return ESP_FAIL;
+    }
+    uint8_t is_running;
+    taskENTER_CRITICAL(&s_sweep_lock);
+    is_running = s_is_sweep_running;
+    if (!is_running) {
+        s_is_sweep_running = 1;
+        s_sweep_remote_id = ir_remote_id;
+    }
+    taskEXIT_CRITICAL(&s_sweep_lock);
+    if (is_running) {
+        ESP_LOGE(TAG, "Sweep already running");
+        return ESP_FAIL;
+    }
+    xTaskNotify(s_ir_sweep_task_handle, SWEEP_START_BIT, eSetBits);
+    return ESP_OK;
+}
+
+esp_err_t ir_sweep_confirm(void)
+{
+    if (!s_is_sweep_running)
+        return ESP_FAIL;
+    xTaskNotify(s_ir_sweep_task_handle, SWEEP_CONFIRM_BIT, eSetBits);
+    return ESP_OK;
+}
+
+esp_err_t ir_sweep_stop(void)
+{
+    if (!s_is_sweep_running)
+        return ESP_FAIL;
+    xTaskNotify(s_ir_sweep_task_handle, SWEEP_STOP_BIT, eSetBits);
+    return ESP_OK;
+}
+
+uint8_t ir_sweep_is_running(void)
+{
+    return s_is_sweep_running;
+}
\ No newline at end of file
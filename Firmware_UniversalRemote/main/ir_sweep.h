@@ -0,0 +1,25 @@
+#ifndef IR_SWEEP_H
+#define IR_SWEEP_H
+#include "esp_err.h"
+#include "ir_manage.h"
+
+#define IR_SWEEP_CONFIRM_WINDOW_MS  2500
+#define IR_SWEEP_NUM_KEY            6
+// Binding builds the info string on the stack and commits the remote to NVS
+#define IR_SWEEP_STACK_SIZE         4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ir_sweep_init(void);
+esp_err_t ir_sweep_start_tv(long ir_remote_id);
+esp_err_t ir_sweep_confirm(void);
+esp_err_t ir_sweep_stop(void);
+uint8_t ir_sweep_is_running(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include <string.h>
+#include "ir_verify.h"
+#include "ir_manage.h"
+#include "mem_budget.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+static const char *TAG = "IR_VERIFY";
+
+static nvs_handle_t s_verify_nvs_handle;
+static TaskHandle_t s_verify_task_handle;
+MEM_TASK_BUFFER(s_verify_task, IR_VERIFY_STACK_SIZE);
+static volatile uint8_t s_is_enabled;
+static ir_verify_stats_t s_stats;
+
+// Frame waiting for its loopback decode, only touched with ir_mutex held
+static uint8_t s_is_pending;
+static IRMP_DATA s_pending_code;
+static int64_t s_pending_us;
+
+// Repetition flags depend on how many frames the receiver caught, so only the payload is compared
+static uint8_t ir_verify_is_same_code(const IRMP_DATA *a, const IRMP_DATA *b)
+{
+    return a->protocol == b->protocol && a->address == b->address && a->command == b->command;
+}
+
+static void ir_verify_finish(const IRMP_DATA *received, int64_t decoded_us)
+{
+    s_is_pending = 0;
+    if (received == NULL) {
+        s_stats.num_timeout++;
+        ESP_LOGW(TAG, "No loopback decode for %x %x %x", s_pending_code.protocol, s_pending_code.address, s_pending_code.command);
+        return;
+    }
+    if (!ir_verify_is_same_code(&s_pending_code, received)) {
+        s_stats.num_mismatch++;
+        s_stats.last_sent = s_pending_code;
+        s_stats.last_received = *received;
+        ESP_LOGW(TAG, "Sent %x %x %x, decoded %x %x %x", s_pending_code.protocol, s_pending_code.address, s_pending_code.command,
+                 received->protocol, received->address, received->command);
+        return;
+    }
+    uint32_t latency_us = decoded_us - s_pending_us;
+    if (s_stats.num_pass == 0 || latency_us < s_stats.min_latency_us) {
+        s_stats.min_latency_us = latency_us;
+    }
+    if (latency_us > s_stats.max_latency_us) {
+        s_stats.max_latency_us = latency_us;
+    }
+    s_stats.sum_latency_us += latency_us;
+    s_stats.num_pass++;
+}
+
+// Caller holds ir_mutex. Settles the pending frame, or drops a stray decode so it is not taken for the next one
+void ir_verify_collect(void)
+{
+    IRMP_DATA received;
+    uint8_t is_decoded = irmp_get_data(&received);
+    if (!s_is_pending) {
+        return;
+    }
+    if (is_decoded) {
+        ir_verify_finish(&received, esp_timer_get_time());
+    } else if (esp_timer_get_time() - s_pending_us > IR_VERIFY_TIMEOUT_MS * 1000) {
+        ir_verify_finish(NULL, 0);
+    }
+}
+
+// Caller holds ir_mutex, the decode is awaited on the verify task
+void ir_verify_submit(const IRMP_DATA *ir_code, int64_t sent_us)
+{
+    if (s_is_pending) {
+        s_stats.num_overrun++;
+    }
+    s_pending_code = *ir_code;
+    s_pending_us = sent_us;
+    s_is_pending = 1;
+    s_stats.num_sent++;
+    xTaskNotifyGive(s_verify_task_handle);
+}
+
+// Caller holds ir_mutex. A learn session takes over the receiver, the pending frame is settled with a decode that
+// already arrived or dropped, so the verify task stops reading
+void ir_verify_cancel(void)
+{
+    IRMP_DATA received;
+    if (!s_is_pending)
+        return;
+    if (irmp_get_data(&received)) {
+        ir_verify_finish(&received, esp_timer_get_time());
+    } else {
+        s_is_pending = 0;
+        s_stats.num_cancel++;
+    }
+}
+
+// Polls once per RTOS tick, which bounds the resolution of the recorded latency
+void ir_verify_task(void *args)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint8_t is_pending = 1;
+        while (is_pending)
+        {
+            vTaskDelay(1);
+            if (xSemaphoreTake(ir_mutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+                ir_verify_collect();
+                is_pending = s_is_pending;
+                xSemaphoreGive(ir_mutex);
+            }
+        }
+    }
+}
+
+esp_err_t ir_verify_init(void)
+{
+    esp_err_t err;
+    err = nvs_open(VERIFY_NAMESPACE, NVS_READWRITE, &s_verify_nvs_handle);
+    if (err != ESP_OK) return err;
+    uint8_t is_enabled = 0;
+    err = nvs_get_u8(s_verify_nvs_handle, VERIFY_ENABLE_KEY, &is_enabled);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
+
+    if (mem_task_create(&ir_verify_task, "IR_VERIFY_TASK", IR_VERIFY_STACK_SIZE, NULL, 2, &s_verify_task_handle, 1,
+                        MEM_TASK_STACK(s_verify_task), MEM_TASK_TCB(s_verify_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    s_is_enabled = is_enabled;
+    return ESP_OK;
+}
+
+esp_err_t ir_verify_set_enable(uint8_t is_enabled)
+{
+    esp_err_t err = nvs_set_u8(s_verify_nvs_handle, VERIFY_ENABLE_KEY, is_enabled);
+    if (err != ESP_OK) return err;
+    err = nvs_commit(s_verify_nvs_handle);
+    if (err != ESP_OK) return err;
+    s_is_enabled = is_enabled;
+    return ESP_OK;
+}
+
+uint8_t IRAM_ATTR ir_verify_is_enabled(void)
+{
+    return s_is_enabled;
+}
+
+esp_err_t ir_verify_get_stats(ir_verify_stats_t *stats)
+{
+    *stats = s_stats;
+    return ESP_OK;
+}
+
+void ir_verify_reset_stats(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef IR_VERIFY_H
+#define IR_VERIFY_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "irmp.h"
+
+#define VERIFY_NAMESPACE            "verify_storage"
+#define VERIFY_ENABLE_KEY           "verify_enable"
+
+#define IR_VERIFY_TIMEOUT_MS        300
+#define IR_VERIFY_STACK_SIZE        2048
+
+typedef struct {
+    uint32_t num_sent;
+    uint32_t num_pass;
+    uint32_t num_mismatch;
+    uint32_t num_timeout;
+    uint32_t num_overrun;
+    uint32_t num_cancel;
+    uint32_t min_latency_us;
+    uint32_t max_latency_us;
+    uint64_t sum_latency_us;
+    IRMP_DATA last_sent;
+    IRMP_DATA last_received;
+} ir_verify_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ir_verify_init(void);
+esp_err_t ir_verify_set_enable(uint8_t is_enabled);
+uint8_t ir_verify_is_enabled(void);
+void ir_verify_collect(void);
+void ir_verify_submit(const IRMP_DATA *ir_code, int64_t sent_us);
+void ir_verify_cancel(void);
+esp_err_t ir_verify_get_stats(ir_verify_stats_t *stats);
+void ir_verify_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
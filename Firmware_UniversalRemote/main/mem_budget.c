@@ -0,0 +1,127 @@
+#include "mem_budget.h"
+#include "esp_heap_caps.h"
+
+typedef struct {
+    TaskHandle_t handle;
+    const char *name;
+    uint32_t stack_size;
+    uint8_t is_static;
+} mem_task_t;
+
+typedef struct {
+    const char *name;
+    uint32_t caps;
+} mem_heap_t;
+
+// Our tasks register at creation, these are looked up by name and reported without a stack size
+static const char *s_system_task_array[] = {"httpd", "tiT", "wifi", "esp_timer", "sys_evt", "mqtt_task"};
+
+static const mem_heap_t s_heap_array[MEM_NUM_HEAP] = {
+    {"8bit",     MALLOC_CAP_8BIT},
+    {"internal", MALLOC_CAP_INTERNAL},
+    {"dma",      MALLOC_CAP_DMA},
+    {"exec",     MALLOC_CAP_EXEC},
+};
+
+static mem_task_t s_task_array[MEM_MAX_TASK];
+static uint8_t s_num_task;
+// Boot stages create their tasks concurrently on both cores
+static portMUX_TYPE s_mem_lock = portMUX_INITIALIZER_UNLOCKED;
+
+BaseType_t mem_task_create(TaskFunction_t task, const char *name, uint32_t stack_size, void *args, UBaseType_t priority,
+                           TaskHandle_t *handle, BaseType_t core, StackType_t *stack, StaticTask_t *tcb)
+{
+    TaskHandle_t task_handle = NULL;
+    if (stack && tcb) {
+        task_handle = xTaskCreateStaticPinnedToCore(task, name, stack_size, args, priority, stack, tcb, core);
+    } else if (xTaskCreatePinnedToCore(task, name, stack_size, args, priority, &task_handle, core) != pdPASS) {
+        task_handle = NULL;
+    }
+    if (task_handle == NULL)
+        return pdFAIL;
+    if (handle) {
+        *handle = task_handle;
+    }
+    taskENTER_CRITICAL(&s_mem_lock);
+    if (s_num_task < MEM_MAX_TASK) {
+        s_task_array[s_num_task++] = (mem_task_t) {task_handle, name, stack_size, stack && tcb};
+    }
+    taskEXIT_CRITICAL(&s_mem_lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t mem_mutex_create(StaticSemaphore_t *buffer)
+{
+    return buffer ? xSemaphoreCreateMutexStatic(buffer) : xSemaphoreCreateMutex();
+}
+
+SemaphoreHandle_t mem_binary_create(StaticSemaphore_t *buffer)
+{
+    return buffer ? xSemaphoreCreateBinaryStatic(buffer) : xSemaphoreCreateBinary();
+}
+
+SemaphoreHandle_t mem_counting_create(UBaseType_t max_count, UBaseType_t initial_count, StaticSemaphore_t *buffer)
+{
+    return buffer ? xSemaphoreCreateCountingStatic(max_count, initial_count, buffer) : xSemaphoreCreateCounting(max_count, initial_count);
+}
+
+QueueHandle_t mem_queue_create(UBaseType_t len, UBaseType_t item_size, StaticQueue_t *buffer, uint8_t *storage)
+{
+    return buffer ? xQueueCreateStatic(len, item_size, storage, buffer) : xQueueCreate(len, item_size);
+}
+
+EventGroupHandle_t mem_event_group_create(StaticEventGroup_t *buffer)
+{
+    return buffer ? xEventGroupCreateStatic(buffer) : xEventGroupCreate();
+}
+
+// Registered tasks first, then the system tasks that exist in this build
+esp_err_t mem_get_task(uint8_t index, mem_task_info_t *info)
+{
+    mem_task_t task;
+    uint8_t num_task;
+    taskENTER_CRITICAL(&s_mem_lock);
+    num_task = s_num_task;
+    if (index < num_task) {
+        task = s_task_array[index];
+    }
+    taskEXIT_CRITICAL(&s_mem_lock);
+    if (index < num_task) {
+        info->name = task.name;
+        info->stack_size = task.stack_size;
+        info->stack_free_min = uxTaskGetStackHighWaterMark(task.handle);
+        info->is_static = task.is_static;
+        return ESP_OK;
+    }
+    index -= num_task;
+    for (int i = 0; i < sizeof(s_system_task_array) / sizeof(s_system_task_array[0]); i++) {
+        TaskHandle_t handle = xTaskGetHandle(s_system_task_array[i]);
+        if (handle == NULL) {
+            continue;
+        }
+        if (index-- == 0) {
+            info->name = s_system_task_array[i];
+            info->stack_size = 0;
+            info->stack_free_min = uxTaskGetStackHighWaterMark(handle);
+            info->is_static = 0;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// Fragmentation is the share of free memory that is not in the largest block
+esp_err_t mem_get_heap(uint8_t index, mem_heap_info_t *info)
+{
+    multi_heap_info_t heap_info;
+    if (index >= MEM_NUM_HEAP)
+        return ESP_ERR_NOT_FOUND;
+    heap_caps_get_info(&heap_info, s_heap_array[index].caps);
+    info->name = s_heap_array[index].name;
+    info->total_bytes = heap_caps_get_total_size(s_heap_array[index].caps);
+    info->free_bytes = heap_info.total_free_bytes;
+    info->min_free_bytes = heap_info.minimum_free_bytes;
+    info->largest_block = heap_info.largest_free_block;
+    info->fragmentation_pct = heap_info.total_free_bytes ? 100 - heap_info.largest_free_block * 100 / heap_info.total_free_bytes : 0;
+    return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_err.h"
+
+// Build with MEM_STATIC_ALLOC=1 to place the stacks, queues and semaphores of our tasks in .bss instead of the heap
+#ifndef MEM_STATIC_ALLOC
+#define MEM_STATIC_ALLOC            0
+#endif
+
+#define MEM_MAX_TASK                16
+#define MEM_NUM_HEAP                4
+// Index of the internal heap in mem_get_heap
+#define MEM_HEAP_INTERNAL           1
+
+// Buffers are only reserved in static builds, the *_create functions fall back to the heap when given NULL
+#if MEM_STATIC_ALLOC
+#define MEM_TASK_BUFFER(name, stack_size)       static StackType_t name##_stack[stack_size]; static StaticTask_t name##_tcb
+#define MEM_TASK_STACK(name)                    (name##_stack)
+#define MEM_TASK_TCB(name)                      (&name##_tcb)
+#define MEM_SEMAPHORE_BUFFER(name)              static StaticSemaphore_t name##_buffer
+#define MEM_SEMAPHORE(name)                     (&name##_buffer)
+#define MEM_QUEUE_BUFFER(name, len, item_size)  static StaticQueue_t name##_buffer; static uint8_t name##_storage[(len) * (item_size)]
+#define MEM_QUEUE(name)                         (&name##_buffer), (name##_storage)
+#define MEM_EVENT_GROUP_BUFFER(name)            static StaticEventGroup_t name##_buffer
+#define MEM_EVENT_GROUP(name)                   (&name##_buffer)
+#else
+#define MEM_TASK_BUFFER(name, stack_size)
+#define MEM_TASK_STACK(name)                    NULL
+#define MEM_TASK_TCB(name)                      NULL
+#define MEM_SEMAPHORE_BUFFER(name)
+#define MEM_SEMAPHORE(name)                     NULL
+#define MEM_QUEUE_BUFFER(name, len, item_size)
+#define MEM_QUEUE(name)                         NULL, NULL
+#define MEM_EVENT_GROUP_BUFFER(name)
+#define MEM_EVENT_GROUP(name)                   NULL
+#endif
+
+typedef struct {
+    const char *name;
+    uint32_t stack_size;
+    uint32_t stack_free_min;
+    uint8_t is_static;
+} mem_task_info_t;
+
+typedef struct {
+    const char *name;
+    size_t total_bytes;
+    size_t free_bytes;
+    size_t min_free_bytes;
+    size_t largest_block;
+    uint8_t fragmentation_pct;
+} mem_heap_info_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t mem_task_create(TaskFunction_t task, const char *name, uint32_t stack_size, void *args, UBaseType_t priority,
+                           TaskHandle_t *handle, BaseType_t core, StackType_t *stack, StaticTask_t *tcb);
+SemaphoreHandle_t mem_mutex_create(StaticSemaphore_t *buffer);
+SemaphoreHandle_t mem_binary_create(StaticSemaphore_t *buffer);
+SemaphoreHandle_t mem_counting_create(UBaseType_t max_count, UBaseType_t initial_count, StaticSemaphore_t *buffer);
+QueueHandle_t mem_queue_create(UBaseType_t len, UBaseType_t item_size, StaticQueue_t *buffer, uint8_t *storage);
+EventGroupHandle_t mem_event_group_create(StaticEventGroup_t *buffer);
+esp_err_t mem_get_task(uint8_t index, mem_task_info_t *info);
+esp_err_t mem_get_heap(uint8_t index, mem_heap_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "mqtt_remote.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "nvs.h"
+#include "ir_manage.h"
+#include "ir_key.h"
+#include "wifi_connect.h"
+#include "mem_budget.h"
+
+#define MQTT_DISCOVERY_TOTAL        (IR_TV_NUM_REMOTE * IR_TV_NUM_CODE)
+
+typedef struct {
+    uint8_t ir_code_id;
+    uint8_t ir_remote_id;
+    esp_err_t err;
+} mqtt_learn_result_t;
+
+static const char *TAG = "MQTT_REMOTE";
+
+static esp_mqtt_client_handle_t s_mqtt_client;
+static nvs_handle_t s_mqtt_nvs_handle;
+static TaskHandle_t s_mqtt_publish_task_handle;
+static SemaphoreHandle_t s_mqtt_mutex;
+static SemaphoreHandle_t s_bench_semp;
+static QueueHandle_t s_learn_queue;
+MEM_TASK_BUFFER(s_mqtt_publish_task, MQTT_PUBLISH_STACK_SIZE);
+MEM_QUEUE_BUFFER(s_learn_queue, MQTT_LEARN_QUEUE_LEN, sizeof(mqtt_learn_result_t));
+MEM_SEMAPHORE_BUFFER(s_mqtt_mutex);
+MEM_SEMAPHORE_BUFFER(s_bench_semp);
+static char s_uri[MQTT_URI_LEN];
+static char s_device_id[13];
+static char s_base_topic[32];
+static char s_availability_topic[48];
+static volatile uint8_t s_is_connected;
+static volatile int s_discovery_cursor = MQTT_DISCOVERY_TOTAL;
+static mqtt_remote_stats_t s_stats;
+
+// Results are joined into one JSON array per batch period, s_batch holds the items without the brackets
+static char s_batch[MQTT_BATCH_LEN];
+static size_t s_batch_len;
+static char s_flush_buf[MQTT_BATCH_LEN + 2];
+
+static volatile uint16_t s_bench_seq = UINT16_MAX;
+static volatile uint32_t s_bench_rtt_us;
+
+// Never waits for the publisher, a result that does not fit in the current batch is dropped and counted
+static void mqtt_remote_add_status(const char *status, int len)
+{
+    if (!s_is_connected || len <= 0 || len >= MQTT_STATUS_LEN) {
+        return;
+    }
+    if (xSemaphoreTake(s_mqtt_mutex, 1) != pdTRUE) {
+        s_stats.dropped++;
+        return;
+    }
+    uint8_t is_first = s_batch_len == 0;
+    if (s_batch_len + len + 1 > sizeof(s_batch)) {
+        s_stats.dropped++;
+    } else {
+        if (!is_first) {
+            s_batch[s_batch_len++] = ',';
+        }
+        memcpy(s_batch + s_batch_len, status, len);
+        s_batch_len += len;
+        s_stats.status++;
+    }
+    xSemaphoreGive(s_mqtt_mutex);
+    if (is_first) {
+        xTaskNotifyGive(s_mqtt_publish_task_handle);
+    }
+}
+
+static void mqtt_remote_tx_done(uint8_t ir_code_id, uint8_t ir_remote_id, esp_err_t err, int64_t queued_us, void *ctx)
+{
+    char status[MQTT_STATUS_LEN];
+    int len = snprintf(status, sizeof(status), "{\"remote\":%d,\"key\":\"%s\",\"action\":\"send\",\"result\":\"%s\",\"latency_us\":%lld}",
+                       ir_remote_id + 1, ir_key_get_name(ir_code_id), err == ESP_OK ? "ok" : esp_err_to_name(err),
+                       (long long) (esp_timer_get_time() - queued_us));
+    mqtt_remote_add_status(status, len);
+}
+
+// Reports every learn, also the ones started from the web page or the serial port. Runs on the IR receive task,
+// so the result is only queued and formatted by the publish task
+static void mqtt_remote_learn_done(uint8_t ir_code_id, uint8_t ir_remote_id, esp_err_t err)
+{
+    mqtt_learn_result_t result = {ir_code_id, ir_remote_id, err};
+    if (xQueueSend(s_learn_queue, &result, 0) != pdTRUE) {
+        s_stats.dropped++;
+        return;
+    }
+    xTaskNotifyGive(s_mqtt_publish_task_handle);
+}
+
+static void mqtt_remote_learn_step(void)
+{
+    mqtt_learn_result_t result;
+    char status[MQTT_STATUS_LEN];
+    while (xQueueReceive(s_learn_queue, &result, 0) == pdTRUE)
+    {
+        int len = snprintf(status, sizeof(status), "{\"remote\":%d,\"key\":\"%s\",\"action\":\"learn\",\"result\":\"%s\"}",
+                           result.ir_remote_id + 1, ir_key_get_name(result.ir_code_id),
+                           result.err == ESP_OK ? "ok" : esp_err_to_name(result.err));
+        mqtt_remote_add_status(status, len);
+        if (result.err == ESP_OK) {
+            s_discovery_cursor = 0;
+        }
+    }
+}
+
+static void mqtt_remote_flush_batch(void)
+{
+    char topic[MQTT_TOPIC_LEN];
+    size_t length = s_batch_len;
+    if (length == 0) {
+        return;
+    }
+    s_flush_buf[0] = '[';
+    memcpy(s_flush_buf + 1, s_batch, length);
+    s_flush_buf[length + 1] = ']';
+    s_batch_len = 0;
+    snprintf(topic, sizeof(topic), "%s/status", s_base_topic);
+    // Results are events, a retained copy would be replayed to every new subscriber
+    const int qos = 0;
+    const int retain = 0;
+    if (esp_mqtt_client_enqueue(s_mqtt_client, topic, s_flush_buf, length + 2, qos, retain, true) < 0) {
+        s_stats.dropped++;
+    } else {
+        s_stats.batch++;
+    }
+}
+
+// Home Assistant button per learned key, a few per period so a reconnect does not flood the outbox
+static void mqtt_remote_discovery_step(void)
+{
+    char topic[MQTT_TOPIC_LEN];
+    char payload[MQTT_DISCOVERY_LEN];
+    int num_sent = 0;
+    while (s_discovery_cursor < MQTT_DISCOVERY_TOTAL && num_sent < MQTT_DISCOVERY_BURST)
+    {
+        uint8_t ir_remote_id = s_discovery_cursor / IR_TV_NUM_CODE;
+        uint8_t ir_code_id = s_discovery_cursor % IR_TV_NUM_CODE;
+        s_discovery_cursor++;
+        if (!ir_is_learned_tv(ir_code_id, ir_remote_id)) {
+            continue;
+        }
+        const char *name = ir_key_get_name(ir_code_id);
+        snprintf(topic, sizeof(topic), "%s/button/%s/tv%d_%s/config", MQTT_DISCOVERY_PREFIX, s_device_id, ir_remote_id + 1, name);
+        int len = snprintf(payload, sizeof(payload),
+                           "{\"name\":\"TV %d %s\",\"unique_id\":\"%s_tv%d_%s\",\"command_topic\":\"%s/tv/%d/%s/set\","
+                           "\"payload_press\":\"%s\",\"availability_topic\":\"%s\","
+                           "\"device\":{\"identifiers\":[\"%s\"],\"name\":\"Universal Remote %s\",\"manufacturer\":\"ESP32_UniversalRemote\"}}",
+                           ir_remote_id + 1, name, s_device_id, ir_remote_id + 1, name, s_base_topic, ir_remote_id + 1, name,
+                           MQTT_PAYLOAD_PRESS, s_availability_topic, s_device_id, s_device_id);
+        if (len <= 0 || len >= sizeof(payload)) {
+            continue;
+        }
+        if (esp_mqtt_client_enqueue(s_mqtt_client, topic, payload, len, 1, 1, true) < 0) {
+            // Outbox full, retry this key next period
+            s_discovery_cursor--;
+            break;
+        }
+        s_stats.discovery++;
+        num_sent++;
+    }
+}
+
+void mqtt_remote_publish_task(void *args)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, s_discovery_cursor < MQTT_DISCOVERY_TOTAL ? pdMS_TO_TICKS(MQTT_BATCH_PERIOD_MS) : portMAX_DELAY);
+        // Keep the batch open for one period so results arriving close together share a message
+        vTaskDelay(pdMS_TO_TICKS(MQTT_BATCH_PERIOD_MS));
+        mqtt_remote_learn_step();
+        xSemaphoreTake(s_mqtt_mutex, portMAX_DELAY);
+        if (s_mqtt_client && s_is_connected) {
+            mqtt_remote_flush_batch();
+            mqtt_remote_discovery_step();
+        } else {
+            s_batch_len = 0;
+        }
+        xSemaphoreGive(s_mqtt_mutex);
+    }
+}
+
+// Bench payload: "<seq> <publish time in us>"
+static void mqtt_remote_handle_bench(const char *data, int data_len)
+{
+    char payload[32];
+    if (data_len <= 0 || data_len >= sizeof(payload)) {
+        return;
+    }
+    memcpy(payload, data, data_len);
+    payload[data_len] = '\0';
+    char *pch;
+    unsigned long seq = strtoul(payload, &pch, 10);
+    long long sent_us = strtoll(pch, NULL, 10);
+    if (seq == s_bench_seq) {
+        s_bench_rtt_us = esp_timer_get_time() - sent_us;
+        xSemaphoreGive(s_bench_semp);
+    }
+}
+
+// Runs on the MQTT task: only parse and queue, the IR send itself happens on the IR TX task
+static void mqtt_remote_handle_data(esp_mqtt_event_handle_t event)
+{
+    char topic[MQTT_TOPIC_LEN];
+    if (event->topic_len <= 0 || event->topic_len >= sizeof(topic) || event->data_len != event->total_data_len) {
+        return;
+    }
+    memcpy(topic, event->topic, event->topic_len);
+    topic[event->topic_len] = '\0';
+    size_t base_len = strlen(s_base_topic);
+    if (strncmp(topic, s_base_topic, base_len) != 0 || topic[base_len] != '/') {
+        return;
+    }
+    char *pch = topic + base_len + 1;
+    if (strcmp(pch, "bench") == 0) {
+        mqtt_remote_handle_bench(event->data, event->data_len);
+        return;
+    }
+    if (strncmp(pch, "tv/", strlen("tv/")) != 0) {
+        return;
+    }
+
+    s_stats.command++;
+    long ir_remote_id = strtol(pch + strlen("tv/"), &pch, 10) - 1;
+    char *action = *pch == '/' ? strchr(pch + 1, '/') : NULL;
+    int ir_code_id = action ? ir_key_lookup(pch + 1, action - pch - 1) : -1;
+    if (ir_remote_id < 0 || ir_remote_id >= IR_TV_NUM_REMOTE || ir_code_id < 0) {
+        ESP_LOGW(TAG, "Unknown command topic %s", topic);
+        s_stats.rejected++;
+        return;
+    }
+    action++;
+
+    esp_err_t err;
+    if (strcmp(action, "set") == 0) {
+        if (event->data_len && (event->data_len != strlen(MQTT_PAYLOAD_PRESS) || strncmp(event->data, MQTT_PAYLOAD_PRESS, event->data_len) != 0)) {
+            s_stats.rejected++;
+            return;
+        }
+        err = ir_send_code_tv_async(ir_code_id, ir_remote_id, IR_TX_SOURCE_OTHER, mqtt_remote_tx_done, NULL);
+        if (err != ESP_OK) {
+            mqtt_remote_tx_done(ir_code_id, ir_remote_id, err, esp_timer_get_time(), NULL);
+        }
+    } else if (strcmp(action, "learn") == 0) {
+        err = ir_add_code_tv_detect(ir_code_id, ir_remote_id);
+        if (err != ESP_OK) {
+            mqtt_remote_learn_done(ir_code_id, ir_remote_id, err);
+        }
+    } else {
+        s_stats.rejected++;
+    }
+}
+
+static void mqtt_remote_event_handler(void *args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+    char topic[MQTT_TOPIC_LEN];
+    switch ((esp_mqtt_event_id_t) event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected to %s", s_uri);
+        s_is_connected = 1;
+        esp_mqtt_client_enqueue(event->client, s_availability_topic, "online", 0, 1, 1, true);
+        snprintf(topic, sizeof(topic), "%s/tv/+/+/+", s_base_topic);
+        esp_mqtt_client_subscribe(event->client, topic, 0);
+        snprintf(topic, sizeof(topic), "%s/bench", s_base_topic);
+        esp_mqtt_client_subscribe(event->client, topic, 0);
+        mqtt_remote_publish_discovery();
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "Disconnected");
+        s_is_connected = 0;
+        break;
+    case MQTT_EVENT_DATA:
+        mqtt_remote_handle_data(event);
+        break;
+    default:
+        break;
+    }
+}
+
+static esp_err_t mqtt_remote_start(void)
+{
+    if (s_uri[0] == '\0') {
+        ESP_LOGI(TAG, "No broker set, MQTT disabled");
+        return ESP_OK;
+    }
+    if (get_wifi_mode() != WIFI_MODE_STA) {
+        ESP_LOGI(TAG, "Not connected to a network, MQTT disabled");
+        return ESP_OK;
+    }
+    esp_mqtt_client_config_t config = {
+        .broker.address.uri = s_uri,
+        .credentials.client_id = s_device_id,
+        .session.last_will = {
+            .topic = s_availability_topic,
+            .msg = "offline",
+            .qos = 1,
+            .retain = 1,
+        },
+    };
+    s_mqtt_client = esp_mqtt_client_init(&config);
+    if (s_mqtt_client == NULL)
+        return ESP_FAIL;
+    esp_mqtt_client_register_event(s_mqtt_client, MQTT_EVENT_ANY, mqtt_remote_event_handler, NULL);
+    return esp_mqtt_client_start(s_mqtt_client);
+}
+
+static void mqtt_remote_stop(void)
+{
+    if (s_mqtt_client == NULL) {
+        return;
+    }
+    s_is_connected = 0;
+    esp_mqtt_client_stop(s_mqtt_client);
+    esp_mqtt_client_destroy(s_mqtt_client);
+    s_mqtt_client = NULL;
+}
+
+esp_err_t mqtt_remote_init(void)
+{
+    uint8_t mac[6];
+    size_t length = sizeof(s_uri);
+    esp_err_t err;
+
+    s_mqtt_mutex = mem_mutex_create(MEM_SEMAPHORE(s_mqtt_mutex));
+    s_bench_semp = mem_binary_create(MEM_SEMAPHORE(s_bench_semp));
+    s_learn_queue = mem_queue_create(MQTT_LEARN_QUEUE_LEN, sizeof(mqtt_learn_result_t), MEM_QUEUE(s_learn_queue));
+    if (s_mqtt_mutex == NULL || s_bench_semp == NULL || s_learn_queue == NULL)
+        return ESP_ERR_NO_MEM;
+
+    err = nvs_open(MQTT_NAMESPACE, NVS_READWRITE, &s_mqtt_nvs_handle);
+    if (err != ESP_OK) return err;
+    err = nvs_get_str(s_mqtt_nvs_handle, MQTT_URI_KEY, s_uri, &length);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
+
+    err = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if (err != ESP_OK) return err;
+    snprintf(s_device_id, sizeof(s_device_id), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    snprintf(s_base_topic, sizeof(s_base_topic), "%s/%s", MQTT_TOPIC_PREFIX, s_device_id);
+    snprintf(s_availability_topic, sizeof(s_availability_topic), "%s/availability", s_base_topic);
+
+    if (mem_task_create(&mqtt_remote_publish_task, "MQTT_PUBLISH_TASK", MQTT_PUBLISH_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, &s_mqtt_publish_task_handle, 0,
+                        MEM_TASK_STACK(s_mqtt_publish_task), MEM_TASK_TCB(s_mqtt_publish_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    ir_set_learn_done_cb(mqtt_remote_learn_done);
+    return mqtt_remote_start();
+}
+
+// An empty uri turns the client off
+esp_err_t mqtt_remote_set_uri(const char *uri)
+{
+    if (strlen(uri) >= sizeof(s_uri))
+        return ESP_ERR_INVALID_ARG;
+    esp_err_t err = nvs_set_str(s_mqtt_nvs_handle, MQTT_URI_KEY, uri);
+    if (err != ESP_OK) return err;
+    err = nvs_commit(s_mqtt_nvs_handle);
+    if (err != ESP_OK) return err;
+    xSemaphoreTake(s_mqtt_mutex, portMAX_DELAY);
+    mqtt_remote_stop();
+    strcpy(s_uri, uri);
+    err = mqtt_remote_start();
+    xSemaphoreGive(s_mqtt_mutex);
+    return err;
+}
+
+esp_err_t mqtt_remote_publish_discovery(void)
+{
+    if (s_mqtt_publish_task_handle == NULL)
+        return ESP_ERR_INVALID_STATE;
+    s_discovery_cursor = 0;
+    xTaskNotifyGive(s_mqtt_publish_task_handle);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_remote_get_stats(mqtt_remote_stats_t *stats)
+{
+    *stats = s_stats;
+    stats->is_enabled = s_mqtt_client != NULL;
+    stats->is_connected = s_is_connected;
+    return ESP_OK;
+}
+
+static int mqtt_remote_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Publishes to its own bench topic one message at a time and times the echo from the broker
+esp_err_t mqtt_remote_bench(uint16_t count, mqtt_remote_bench_t *result)
+{
+    char topic[MQTT_TOPIC_LEN];
+    char payload[32];
+    if (count == 0 || count > MQTT_BENCH_MAX)
+        return ESP_ERR_INVALID_ARG;
+    if (s_mqtt_client == NULL || !s_is_connected)
+        return ESP_ERR_INVALID_STATE;
+    uint32_t *rtt_array = malloc(count * sizeof(uint32_t));
+    if (rtt_array == NULL)
+        return ESP_ERR_NO_MEM;
+
+    memset(result, 0, sizeof(mqtt_remote_bench_t));
+    snprintf(topic, sizeof(topic), "%s/bench", s_base_topic);
+    xSemaphoreTake(s_bench_semp, 0);
+    uint64_t sum_us = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        s_bench_seq = i;
+        int len = snprintf(payload, sizeof(payload), "%u %lld", i, (long long) esp_timer_get_time());
+        if (esp_mqtt_client_publish(s_mqtt_client, topic, payload, len, 0, 0) < 0)
+            break;
+        result->sent++;
+        if (xSemaphoreTake(s_bench_semp, pdMS_TO_TICKS(MQTT_BENCH_TIMEOUT_MS)) != pdTRUE)
+            continue;
+        rtt_array[result->received++] = s_bench_rtt_us;
+        sum_us += s_bench_rtt_us;
+    }
+    s_bench_seq = UINT16_MAX;
+
+    if (result->received) {
+        qsort(rtt_array, result->received, sizeof(uint32_t), mqtt_remote_compare_u32);
+        result->min_us = rtt_array[0];
+        result->max_us = rtt_array[result->received - 1];
+        result->avg_us = sum_us / result->received;
+        result->p50_us = rtt_array[result->received / 2];
+        result->p95_us = rtt_array[(result->received * 95 - 1) / 100];
+    }
+    free(rtt_array);
+    return result->received ? ESP_OK : ESP_ERR_TIMEOUT;
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef MQTT_REMOTE_H
+#define MQTT_REMOTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MQTT_NAMESPACE              "mqtt_storage"
+#define MQTT_URI_KEY                "mqtt_uri"
+#define MQTT_URI_LEN                128
+
+// Commands: <prefix>/<id>/tv/<remote>/<KEY>/set|learn, results are batched to <prefix>/<id>/status
+#define MQTT_TOPIC_PREFIX           "universalremote"
+#define MQTT_DISCOVERY_PREFIX       "homeassistant"
+#define MQTT_TOPIC_LEN              128
+#define MQTT_PAYLOAD_PRESS          "PRESS"
+
+#define MQTT_BATCH_PERIOD_MS        50
+#define MQTT_PUBLISH_STACK_SIZE     4096
+#define MQTT_BATCH_LEN              1024
+#define MQTT_STATUS_LEN             128
+#define MQTT_DISCOVERY_BURST        4
+#define MQTT_DISCOVERY_LEN          512
+#define MQTT_BENCH_MAX              500
+#define MQTT_BENCH_TIMEOUT_MS       1000
+#define MQTT_LEARN_QUEUE_LEN        4
+
+typedef struct {
+    uint8_t is_enabled;
+    uint8_t is_connected;
+    uint32_t command;
+    uint32_t rejected;
+    uint32_t status;
+    uint32_t batch;
+    uint32_t dropped;
+    uint32_t discovery;
+} mqtt_remote_stats_t;
+
+typedef struct {
+    uint16_t sent;
+    uint16_t received;
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t max_us;
+} mqtt_remote_bench_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t mqtt_remote_init(void);
+esp_err_t mqtt_remote_set_uri(const char *uri);
+esp_err_t mqtt_remote_publish_discovery(void);
+esp_err_t mqtt_remote_get_stats(mqtt_remote_stats_t *stats);
+esp_err_t mqtt_remote_bench(uint16_t count, mqtt_remote_bench_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
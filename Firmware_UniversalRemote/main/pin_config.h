@@ -3,6 +3,7 @@
 
 #define LED_PIN              GPIO_NUM_17
 #define KEY_PIN              GPIO_NUM_16
+#define IR_TX_PIN            GPIO_NUM_4
 
 #define DEBOUNCE_PERIOD_MS   100
 
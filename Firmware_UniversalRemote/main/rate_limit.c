@@ -0,0 +1,135 @@
+#include <string.h>
+#include "rate_limit.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "mem_budget.h"
+
+// Tokens are kept in thousandths so slow refill rates do not round down to nothing
+#define RATE_LIMIT_TOKEN            1000
+
+typedef struct {
+    uint32_t per_s;
+    uint32_t burst;
+    const char *name;
+} rate_limit_rule_t;
+
+typedef struct {
+    uint8_t addr[RATE_LIMIT_ADDR_LEN];
+    uint8_t is_used;
+    int64_t last_us;
+    int64_t refill_us[RATE_LIMIT_NUM_CLASS];
+    uint32_t token[RATE_LIMIT_NUM_CLASS];
+} rate_limit_client_t;
+
+static const rate_limit_rule_t s_rule_array[RATE_LIMIT_NUM_CLASS] = {
+    [RATE_LIMIT_CLASS_IR]   = {RATE_LIMIT_IR_PER_S,   RATE_LIMIT_IR_BURST,   "ir"},
+    [RATE_LIMIT_CLASS_API]  = {RATE_LIMIT_API_PER_S,  RATE_LIMIT_API_BURST,  "api"},
+    [RATE_LIMIT_CLASS_PAGE] = {RATE_LIMIT_PAGE_PER_S, RATE_LIMIT_PAGE_BURST, "page"},
+};
+
+static rate_limit_client_t s_client_array[RATE_LIMIT_MAX_CLIENT];
+static rate_limit_stats_t s_stats;
+static SemaphoreHandle_t s_rate_limit_mutex;
+MEM_SEMAPHORE_BUFFER(s_rate_limit_mutex);
+
+// Loopback is the device itself (jitter load generator, local tools), it is never limited
+static uint8_t rate_limit_is_loopback(const uint8_t *addr)
+{
+    static const uint8_t v6_loopback[RATE_LIMIT_ADDR_LEN] = {[15] = 1};
+    static const uint8_t v4_mapped[12] = {[10] = 0xff, [11] = 0xff};
+    return memcmp(addr, v6_loopback, RATE_LIMIT_ADDR_LEN) == 0 || (memcmp(addr, v4_mapped, sizeof(v4_mapped)) == 0 && addr[12] == 127);
+}
+
+// Known client, else a free slot, else the client that was idle the longest
+static rate_limit_client_t *rate_limit_get_client(const uint8_t *addr, int64_t now_us)
+{
+    rate_limit_client_t *oldest = NULL;
+    for (int i = 0; i < RATE_LIMIT_MAX_CLIENT; i++) {
+        rate_limit_client_t *client = &s_client_array[i];
+        if (client->is_used && memcmp(client->addr, addr, RATE_LIMIT_ADDR_LEN) == 0) {
+            return client;
+        }
+        if (oldest == NULL || !client->is_used || (oldest->is_used && client->last_us < oldest->last_us)) {
+            oldest = client;
+        }
+    }
+    if (oldest->is_used) {
+        s_stats.eviction++;
+    } else {
+        s_stats.num_client++;
+    }
+    memcpy(oldest->addr, addr, RATE_LIMIT_ADDR_LEN);
+    oldest->is_used = 1;
+    for (int i = 0; i < RATE_LIMIT_NUM_CLASS; i++) {
+        oldest->token[i] = s_rule_array[i].burst * RATE_LIMIT_TOKEN;
+        oldest->refill_us[i] = now_us;
+    }
+    return oldest;
+}
+
+esp_err_t rate_limit_init(void)
+{
+    s_rate_limit_mutex = mem_mutex_create(MEM_SEMAPHORE(s_rate_limit_mutex));
+    if (s_rate_limit_mutex == NULL)
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+rate_limit_result_t rate_limit_admit(const uint8_t *addr, rate_limit_class_t limit_class, uint32_t *retry_after_s)
+{
+    rate_limit_class_stats_t *class_stats = &s_stats.class_stats[limit_class];
+    const rate_limit_rule_t *rule = &s_rule_array[limit_class];
+    int64_t now_us = esp_timer_get_time();
+
+    rate_limit_result_t result = RATE_LIMIT_ADMIT;
+    xSemaphoreTake(s_rate_limit_mutex, portMAX_DELAY);
+    // Fail fast while the web share of the IR path is backed up instead of letting the request time out on ir_mutex
+    if (limit_class == RATE_LIMIT_CLASS_IR) {
+        uint8_t inflight = ir_get_tx_inflight(IR_TX_SOURCE_WEB);
+        if (inflight >= RATE_LIMIT_IR_INFLIGHT) {
+            *retry_after_s = (inflight * RATE_LIMIT_IR_FRAME_MS + 999) / 1000;
+            class_stats->overloaded++;
+            xSemaphoreGive(s_rate_limit_mutex);
+            return RATE_LIMIT_OVERLOAD;
+        }
+    }
+    if (rate_limit_is_loopback(addr)) {
+        class_stats->admitted++;
+        xSemaphoreGive(s_rate_limit_mutex);
+        return RATE_LIMIT_ADMIT;
+    }
+
+    rate_limit_client_t *client = rate_limit_get_client(addr, now_us);
+    client->last_us = now_us;
+    uint64_t refill = (uint64_t) (now_us - client->refill_us[limit_class]) * rule->per_s * RATE_LIMIT_TOKEN / 1000000;
+    if (refill > 0) {
+        uint64_t token = client->token[limit_class] + refill;
+        client->token[limit_class] = token < rule->burst * RATE_LIMIT_TOKEN ? token : rule->burst * RATE_LIMIT_TOKEN;
+        client->refill_us[limit_class] = now_us;
+    }
+    if (client->token[limit_class] >= RATE_LIMIT_TOKEN) {
+        client->token[limit_class] -= RATE_LIMIT_TOKEN;
+        class_stats->admitted++;
+    } else {
+        uint32_t wait_ms = (RATE_LIMIT_TOKEN - client->token[limit_class]) * 1000 / (rule->per_s * RATE_LIMIT_TOKEN);
+        *retry_after_s = wait_ms / 1000 + 1;
+        class_stats->throttled++;
+        result = RATE_LIMIT_THROTTLE;
+    }
+    xSemaphoreGive(s_rate_limit_mutex);
+    return result;
+}
+
+const char *rate_limit_get_class_name(rate_limit_class_t limit_class)
+{
+    return limit_class < RATE_LIMIT_NUM_CLASS ? s_rule_array[limit_class].name : "";
+}
+
+esp_err_t rate_limit_get_stats(rate_limit_stats_t *stats)
+{
+    xSemaphoreTake(s_rate_limit_mutex, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_rate_limit_mutex);
+    return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "ir_manage.h"
+
+#define RATE_LIMIT_ADDR_LEN         16
+#define RATE_LIMIT_MAX_CLIENT       16
+
+// Sustained requests per second and burst per client for each endpoint class
+#define RATE_LIMIT_IR_PER_S         4
+#define RATE_LIMIT_IR_BURST         8
+#define RATE_LIMIT_API_PER_S        10
+#define RATE_LIMIT_API_BURST        20
+#define RATE_LIMIT_PAGE_PER_S       20
+#define RATE_LIMIT_PAGE_BURST       40
+
+// Web IR requests fail fast once every TX queue slot reserved for the web is in flight
+#define RATE_LIMIT_IR_INFLIGHT      IR_TX_WEB_SLOTS
+#define RATE_LIMIT_IR_FRAME_MS      150
+
+typedef enum {
+    RATE_LIMIT_CLASS_IR,
+    RATE_LIMIT_CLASS_API,
+    RATE_LIMIT_CLASS_PAGE,
+    RATE_LIMIT_NUM_CLASS,
+} rate_limit_class_t;
+
+typedef enum {
+    RATE_LIMIT_ADMIT,
+    RATE_LIMIT_THROTTLE,
+    RATE_LIMIT_OVERLOAD,
+} rate_limit_result_t;
+
+typedef struct {
+    uint32_t admitted;
+    uint32_t throttled;
+    uint32_t overloaded;
+} rate_limit_class_stats_t;
+
+typedef struct {
+    rate_limit_class_stats_t class_stats[RATE_LIMIT_NUM_CLASS];
+    uint16_t num_client;
+    uint32_t eviction;
+} rate_limit_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t rate_limit_init(void);
+rate_limit_result_t rate_limit_admit(const uint8_t *addr, rate_limit_class_t limit_class, uint32_t *retry_after_s);
+const char *rate_limit_get_class_name(rate_limit_class_t limit_class);
+esp_err_t rate_limit_get_stats(rate_limit_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
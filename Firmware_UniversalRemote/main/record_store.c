@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include "record_store.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "RECORD_STORE";
+
+static record_stats_t s_stats;
+
+static void record_get_key(char *slot_key, const char *key, uint8_t slot, uint8_t is_header)
+{
+    snprintf(slot_key, RECORD_SLOT_KEY_LEN, is_header ? "%s.h%c" : "%s.%c", key, 'a' + slot);
+}
+
+static uint32_t record_get_header_crc(const record_header_t *header)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *) header, offsetof(record_header_t, header_crc));
+}
+
+// Checks the header and the size of its payload blob, the payload itself is not read
+static esp_err_t record_get_header(nvs_handle_t handle, const char *key, uint8_t slot, record_header_t *header)
+{
+    char slot_key[RECORD_SLOT_KEY_LEN];
+    size_t length = sizeof(record_header_t);
+    record_get_key(slot_key, key, slot, 1);
+    esp_err_t err = nvs_get_blob(handle, slot_key, header, &length);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+        return err;
+    if (err != ESP_OK || length != sizeof(record_header_t) || header->magic != RECORD_MAGIC || header->header_crc != record_get_header_crc(header))
+        return ESP_ERR_INVALID_CRC;
+
+    length = 0;
+    record_get_key(slot_key, key, slot, 0);
+    err = nvs_get_blob(handle, slot_key, NULL, &length);
+    if (err != ESP_OK || length != header->length)
+        return ESP_ERR_INVALID_CRC;
+    return ESP_OK;
+}
+
+// Fills the slots with a valid header, newest generation first
+static void record_scan(nvs_handle_t handle, const char *key, record_header_t *header_array, uint8_t *slot_array,
+                        uint8_t *num_present, uint8_t *num_valid)
+{
+    *num_present = 0;
+    *num_valid = 0;
+    for (uint8_t slot = 0; slot < RECORD_NUM_SLOT; slot++) {
+        esp_err_t err = record_get_header(handle, key, slot, &header_array[*num_valid]);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            continue;
+        }
+        (*num_present)++;
+        if (err == ESP_OK) {
+            slot_array[(*num_valid)++] = slot;
+        }
+    }
+    if (*num_valid == RECORD_NUM_SLOT && header_array[1].generation > header_array[0].generation) {
+        record_header_t header = header_array[0];
+        header_array[0] = header_array[1];
+        header_array[1] = header;
+        slot_array[0] = 1;
+        slot_array[1] = 0;
+    }
+}
+
+esp_err_t record_read(nvs_handle_t handle, const char *key, void *payload, size_t *length, uint16_t *version)
+{
+    record_header_t header_array[RECORD_NUM_SLOT];
+    uint8_t slot_array[RECORD_NUM_SLOT];
+    uint8_t num_present, num_valid;
+    char slot_key[RECORD_SLOT_KEY_LEN];
+    esp_err_t err = ESP_ERR_INVALID_CRC;
+
+    int64_t start_us = esp_timer_get_time();
+    record_scan(handle, key, header_array, slot_array, &num_present, &num_valid);
+    int64_t header_us = esp_timer_get_time();
+    s_stats.header_us += header_us - start_us;
+    if (num_present == 0)
+        return ESP_ERR_NVS_NOT_FOUND;
+    s_stats.num_read++;
+    s_stats.num_bad_slot += num_present - num_valid;
+
+    for (uint8_t i = 0; i < num_valid; i++) {
+        record_header_t *header = &header_array[i];
+        size_t payload_len = header->length;
+        if (payload_len > *length) {
+            ESP_LOGE(TAG, "%s generation %lu is %d bytes, expected at most %d", key, (unsigned long) header->generation,
+                     (int) payload_len, (int) *length);
+            err = ESP_ERR_INVALID_SIZE;
+            continue;
+        }
+        record_get_key(slot_key, key, slot_array[i], 0);
+        if (nvs_get_blob(handle, slot_key, payload, &payload_len) != ESP_OK
+            || esp_rom_crc32_le(0, payload, payload_len) != header->payload_crc) {
+            s_stats.num_bad_slot++;
+            err = ESP_ERR_INVALID_CRC;
+            continue;
+        }
+        if (i > 0 || num_valid < num_present) {
+            s_stats.num_fallback++;
+            ESP_LOGW(TAG, "%s: newest slot is damaged, using generation %lu", key, (unsigned long) header->generation);
+        }
+        *length = payload_len;
+        *version = header->version;
+        s_stats.payload_us += esp_timer_get_time() - header_us;
+        return ESP_OK;
+    }
+    ESP_LOGE(TAG, "%s: no valid slot", key);
+    return err;
+}
+
+// Overwrites the slot that does not hold the newest valid generation, the caller commits
+esp_err_t record_write(nvs_handle_t handle, const char *key, uint16_t version, const void *payload, size_t length)
+{
+    record_header_t header_array[RECORD_NUM_SLOT];
+    uint8_t slot_array[RECORD_NUM_SLOT];
+    uint8_t num_present, num_valid;
+    char slot_key[RECORD_SLOT_KEY_LEN];
+    if (strlen(key) > RECORD_MAX_KEY_LEN)
+        return ESP_ERR_INVALID_ARG;
+
+    record_scan(handle, key, header_array, slot_array, &num_present, &num_valid);
+    uint8_t slot = num_valid ? (slot_array[0] + 1) % RECORD_NUM_SLOT : 0;
+    record_header_t header = {
+        .magic = RECORD_MAGIC,
+        .version = version,
+        .generation = num_valid ? header_array[0].generation + 1 : 1,
+        .length = length,
+        .payload_crc = esp_rom_crc32_le(0, payload, length),
+    };
+    header.header_crc = record_get_header_crc(&header);
+
+    record_get_key(slot_key, key, slot, 0);
+    esp_err_t err = nvs_set_blob(handle, slot_key, payload, length);
+    if (err != ESP_OK)
+        return err;
+    record_get_key(slot_key, key, slot, 1);
+    err = nvs_set_blob(handle, slot_key, &header, sizeof(header));
+    if (err != ESP_OK)
+        return err;
+    s_stats.num_write++;
+    return ESP_OK;
+}
+
+// Drops both slots of a record that is no longer used, the caller commits
+void record_erase(nvs_handle_t handle, const char *key)
+{
+    char slot_key[RECORD_SLOT_KEY_LEN];
+    for (uint8_t slot = 0; slot < RECORD_NUM_SLOT; slot++) {
+        record_get_key(slot_key, key, slot, 1);
+        nvs_erase_key(handle, slot_key);
+        record_get_key(slot_key, key, slot, 0);
+        nvs_erase_key(handle, slot_key);
+    }
+}
+
+void record_count_migrated(void)
+{
+    s_stats.num_migrated++;
+}
+
+esp_err_t record_get_stats(record_stats_t *stats)
+{
+    *stats = s_stats;
+    return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef RECORD_STORE_H
+#define RECORD_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+/*
+ * Versioned NVS records kept in two slots. Slot x of key k is stored as a small header blob "k.hx" and a payload
+ * blob "k.x". The payload is written before its header, so the previous generation stays valid until the new
+ * header lands. Readers check both headers first and only load the payload of the newest valid one.
+ */
+#define RECORD_MAGIC                0x5352
+#define RECORD_NUM_SLOT             2
+#define RECORD_MAX_KEY_LEN          12
+#define RECORD_SLOT_KEY_LEN         (RECORD_MAX_KEY_LEN + 4)
+
+typedef struct {
+    uint16_t magic;
+    uint16_t version;
+    uint32_t generation;
+    uint32_t length;
+    uint32_t payload_crc;
+    uint32_t header_crc;
+} record_header_t;
+
+typedef struct {
+    uint32_t num_read;
+    uint32_t num_write;
+    uint32_t num_fallback;
+    uint32_t num_bad_slot;
+    uint32_t num_migrated;
+    uint32_t header_us;
+    uint32_t payload_us;
+} record_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t record_read(nvs_handle_t handle, const char *key, void *payload, size_t *length, uint16_t *version);
+esp_err_t record_write(nvs_handle_t handle, const char *key, uint16_t version, const void *payload, size_t length);
+void record_erase(nvs_handle_t handle, const char *key);
+void record_count_migrated(void);
+esp_err_t record_get_stats(record_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "scheduler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "nvs.h"
+#include "ir_manage.h"
+#include "mem_budget.h"
+#include "record_store.h"
+
+static const char *TAG = "SCHEDULER";
+
+static TaskHandle_t s_scheduler_task_handle;
+static SemaphoreHandle_t s_scheduler_mutex;
+MEM_TASK_BUFFER(s_scheduler_task, SCHEDULER_STACK_SIZE);
+MEM_SEMAPHORE_BUFFER(s_scheduler_mutex);
+static nvs_handle_t s_scheduler_nvs_handle;
+static char s_timezone[SCHEDULER_TZ_LEN] = SCHEDULER_DEFAULT_TIMEZONE;
+
+// Jobs live in a fixed pool indexed by job id, the min-heap orders job ids by next run time
+static scheduler_job_t s_job_array[SCHEDULER_MAX_JOB];
+static uint16_t s_heap[SCHEDULER_MAX_JOB];
+static uint16_t s_heap_pos[SCHEDULER_MAX_JOB];
+static uint16_t s_heap_len;
+
+static void heap_swap(uint16_t a, uint16_t b)
+{
+    uint16_t job_id = s_heap[a];
+    s_heap[a] = s_heap[b];
+    s_heap[b] = job_id;
+    s_heap_pos[s_heap[a]] = a;
+    s_heap_pos[s_heap[b]] = b;
+}
+
+static uint8_t heap_less(uint16_t a, uint16_t b)
+{
+    return s_job_array[s_heap[a]].next_s < s_job_array[s_heap[b]].next_s;
+}
+
+static void heap_sift_up(uint16_t pos)
+{
+    while (pos > 0 && heap_less(pos, (pos - 1) / 2))
+    {
+        heap_swap(pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+static void heap_sift_down(uint16_t pos)
+{
+    while (1)
+    {
+        uint16_t smallest = pos;
+        uint16_t left = 2 * pos + 1;
+        uint16_t right = left + 1;
+        if (left < s_heap_len && heap_less(left, smallest)) smallest = left;
+        if (right < s_heap_len && heap_less(right, smallest)) smallest = right;
+        if (smallest == pos) break;
+        heap_swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+static void heap_push(uint16_t job_id)
+{
+    s_heap[s_heap_len] = job_id;
+    s_heap_pos[job_id] = s_heap_len;
+    s_heap_len++;
+    heap_sift_up(s_heap_len - 1);
+}
+
+static void heap_remove(uint16_t job_id)
+{
+    uint16_t pos = s_heap_pos[job_id];
+    s_heap_len--;
+    if (pos == s_heap_len) return;
+    heap_swap(pos, s_heap_len);
+    heap_sift_down(pos);
+    heap_sift_up(pos);
+}
+
+static uint8_t scheduler_is_time_valid(time_t now)
+{
+    return now >= SCHEDULER_MIN_VALID_TIME;
+}
+
+// spec: "remote_id code_id when [period_s]", when is "+seconds", "HH:MM" local time or an epoch timestamp
+static esp_err_t scheduler_parse_spec(const char *spec, scheduler_job_t *job)
+{
+    char *end;
+    time_t now = time(NULL);
+    long ir_remote_id = strtol(spec, &end, 10);
+    if (end == spec) return ESP_ERR_INVALID_ARG;
+    spec = end;
+    long ir_code_id = strtol(spec, &end, 10);
+    if (end == spec) return ESP_ERR_INVALID_ARG;
+    spec = end;
+    while (*spec == ' ')
+    {
+        spec++;
+    }
+
+    if (ir_remote_id < 0 || ir_remote_id >= IR_TV_NUM_REMOTE || ir_code_id < 0 || ir_code_id >= IR_TV_NUM_CODE)
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t is_time_of_day = strchr(spec, ':') != NULL && strchr(spec, ':') - spec <= 2;
+    // Relative times need the clock, before SNTP has synced they would land in 1970 and be dropped as missed
+    if ((*spec == '+' || is_time_of_day) && !scheduler_is_time_valid(now))
+        return ESP_ERR_INVALID_STATE;
+
+    if (*spec == '+') {
+        job->next_s = now + strtol(spec + 1, &end, 10);
+        if (end == spec + 1) return ESP_ERR_INVALID_ARG;
+    } else if (is_time_of_day) {
+        struct tm timeinfo;
+        localtime_r(&now, &timeinfo);
+        timeinfo.tm_hour = strtol(spec, &end, 10);
+        if (end == spec || *end != ':') return ESP_ERR_INVALID_ARG;
+        const char *minute = end + 1;
+        timeinfo.tm_min = strtol(minute, &end, 10);
+        if (end == minute) return ESP_ERR_INVALID_ARG;
+        timeinfo.tm_sec = 0;
+        job->next_s = mktime(&timeinfo);
+        if (job->next_s <= now) {
+            job->next_s += 24 * 60 * 60;
+        }
+    } else {
+        job->next_s = strtoll(spec, &end, 10);
+        if (end == spec) return ESP_ERR_INVALID_ARG;
+    }
+
+    job->period_s = strtoul(end, NULL, 10);
+    job->ir_remote_id = ir_remote_id;
+    job->ir_code_id = ir_code_id;
+    job->in_use = 1;
+    return ESP_OK;
+}
+
+static void scheduler_encode(uint16_t job_id, const scheduler_job_t *job, uint8_t *out)
+{
+    out[0] = job->ir_remote_id;
+    out[1] = job->ir_code_id;
+    for (int i = 0; i < 4; i++) {
+        out[2 + i] = (job->period_s >> (8 * i)) & 0xFF;
+    }
+    for (int i = 0; i < 8; i++) {
+        out[6 + i] = ((uint64_t) job->next_s >> (8 * i)) & 0xFF;
+    }
+    out[14] = job_id & 0xFF;
+    out[15] = job_id >> 8;
+}
+
+// Returns the job id stored in the record, version 1 records have none
+static uint16_t scheduler_decode(const uint8_t *in, uint16_t version, scheduler_job_t *job)
+{
+    uint64_t next_s = 0;
+    job->ir_remote_id = in[0];
+    job->ir_code_id = in[1];
+    job->period_s = in[2] | (in[3] << 8) | (in[4] << 16) | ((uint32_t) in[5] << 24);
+    for (int i = 0; i < 8; i++) {
+        next_s |= (uint64_t) in[6 + i] << (8 * i);
+    }
+    job->next_s = (int64_t) next_s;
+    job->in_use = 1;
+    return version == 1 ? 0 : in[14] | (in[15] << 8);
+}
+
+static esp_err_t scheduler_persist(void)
+{
+    uint8_t *blob = malloc(s_heap_len * SCHEDULER_JOB_RECORD_LEN + 1);
+    if (blob == NULL)
+        return ESP_ERR_NO_MEM;
+    size_t length = 0;
+    for (int i = 0; i < SCHEDULER_MAX_JOB; i++) {
+        if (s_job_array[i].in_use) {
+            scheduler_encode(i, &s_job_array[i], blob + length);
+            length += SCHEDULER_JOB_RECORD_LEN;
+        }
+    }
+    esp_err_t err = record_write(s_scheduler_nvs_handle, SCHEDULER_JOB_KEY, SCHEDULER_RECORD_VERSION, blob, length);
+    free(blob);
+    if (err != ESP_OK)
+        return err;
+    return nvs_commit(s_scheduler_nvs_handle);
+}
+
+// Jobs keep the id they were stored with. Recurring jobs missed while powered off are moved to their next slot,
+// missed one-shot jobs are dropped. Nothing changes when the payload is rejected
+static esp_err_t scheduler_load_jobs(const uint8_t *payload, size_t length, uint16_t version)
+{
+    time_t now = time(NULL);
+    if (version != 1 && version != SCHEDULER_RECORD_VERSION)
+        return ESP_ERR_INVALID_VERSION;
+    size_t record_len = version == 1 ? SCHEDULER_JOB_RECORD_LEN_V1 : SCHEDULER_JOB_RECORD_LEN;
+    uint16_t num_job = length / record_len;
+    if (length % record_len != 0 || num_job > SCHEDULER_MAX_JOB)
+        return ESP_ERR_INVALID_SIZE;
+
+    scheduler_job_t job;
+    uint8_t is_used_array[SCHEDULER_MAX_JOB / 8] = {0};
+    for (uint16_t i = 0; i < num_job; i++) {
+        uint16_t job_id = version == 1 ? i : scheduler_decode(payload + i * record_len, version, &job);
+        if (job_id >= SCHEDULER_MAX_JOB || (is_used_array[job_id / 8] & (1 << (job_id % 8)))) {
+            ESP_LOGE(TAG, "Invalid or duplicate job id %d", job_id);
+            return ESP_ERR_INVALID_ARG;
+        }
+        is_used_array[job_id / 8] |= 1 << (job_id % 8);
+    }
+
+    memset(s_job_array, 0, sizeof(s_job_array));
+    s_heap_len = 0;
+    for (uint16_t i = 0; i < num_job; i++) {
+        uint16_t job_id = scheduler_decode(payload + i * record_len, version, &job);
+        if (version == 1) {
+            job_id = i;
+        }
+        if (scheduler_is_time_valid(now) && job.next_s < now) {
+            if (job.period_s == 0) {
+                continue;
+            }
+            job.next_s += ((now - job.next_s) / job.period_s + 1) * job.period_s;
+        }
+        s_job_array[job_id] = job;
+        heap_push(job_id);
+    }
+    return ESP_OK;
+}
+
+static void scheduler_send_done(uint8_t ir_code_id, uint8_t ir_remote_id, esp_err_t err, int64_t queued_us, void *ctx)
+{
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Job %d: sending code %d on TV remote %d failed: %s", (int) (uintptr_t) ctx, ir_code_id, ir_remote_id + 1, esp_err_to_name(err));
+    }
+}
+
+// Returns 1 when a job ran or was skipped, the caller persists the new next run times
+static uint8_t scheduler_dispatch(time_t now)
+{
+    uint8_t is_changed = 0;
+    while (s_heap_len > 0 && s_job_array[s_heap[0]].next_s <= now)
+    {
+        uint16_t job_id = s_heap[0];
+        scheduler_job_t *job = &s_job_array[job_id];
+        if (now - job->next_s <= SCHEDULER_MISS_GRACE_S) {
+            ESP_LOGI(TAG, "Job %d: sending code %d on TV remote %d", job_id, job->ir_code_id, job->ir_remote_id + 1);
+            // Queued, the scheduler lock is not held while the frame goes out
+            esp_err_t err = ir_send_code_tv_async(job->ir_code_id, job->ir_remote_id, IR_TX_SOURCE_OTHER, scheduler_send_done, (void *) (uintptr_t) job_id);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Job %d: failed to queue code: %s", job_id, esp_err_to_name(err));
+            }
+        } else {
+            ESP_LOGW(TAG, "Job %d: skipped, missed by %lld s", job_id, (long long) (now - job->next_s));
+        }
+        if (job->period_s) {
+            job->next_s += ((now - job->next_s) / job->period_s + 1) * job->period_s;
+            heap_sift_down(0);
+        } else {
+            heap_remove(job_id);
+            job->in_use = 0;
+        }
+        is_changed = 1;
+    }
+    return is_changed;
+}
+
+void scheduler_task(void *args)
+{
+    TickType_t wait_ticks;
+    while (1)
+    {
+        time_t now = time(NULL);
+        xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+        if (!scheduler_is_time_valid(now)) {
+            wait_ticks = 1000 / portTICK_PERIOD_MS;
+        } else {
+            // Without this a reboot within the grace period reloads the old next_s and runs the job again
+            if (scheduler_dispatch(now) && scheduler_persist() != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to persist jobs");
+            }
+            int64_t wait_s = SCHEDULER_MAX_WAIT_S;
+            if (s_heap_len > 0 && s_job_array[s_heap[0]].next_s - now < wait_s) {
+                wait_s = s_job_array[s_heap[0]].next_s - now;
+            }
+            wait_ticks = wait_s * 1000 / portTICK_PERIOD_MS;
+        }
+        xSemaphoreGive(s_scheduler_mutex);
+        ulTaskNotifyTake(pdTRUE, wait_ticks);
+    }
+}
+
+esp_err_t scheduler_init(void)
+{
+    esp_err_t err;
+    size_t length = 0;
+
+    s_scheduler_mutex = mem_mutex_create(MEM_SEMAPHORE(s_scheduler_mutex));
+    if (s_scheduler_mutex == NULL)
+        return ESP_ERR_NO_MEM;
+
+    err = nvs_open(SCHEDULER_NAMESPACE, NVS_READWRITE, &s_scheduler_nvs_handle);
+    if (err != ESP_OK) return err;
+
+    length = sizeof(s_timezone);
+    if (nvs_get_str(s_scheduler_nvs_handle, SCHEDULER_TZ_KEY, s_timezone, &length) != ESP_OK) {
+        strcpy(s_timezone, SCHEDULER_DEFAULT_TIMEZONE);
+    }
+    setenv("TZ", s_timezone, 1);
+    tzset();
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(SCHEDULER_NTP_SERVER);
+    err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) return err;
+
+    length = SCHEDULER_MAX_JOB * SCHEDULER_JOB_RECORD_LEN;
+    uint8_t *blob = malloc(length);
+    if (blob == NULL)
+        return ESP_ERR_NO_MEM;
+    uint16_t version = SCHEDULER_RECORD_VERSION;
+    uint8_t is_legacy = 0;
+    err = record_read(s_scheduler_nvs_handle, SCHEDULER_JOB_KEY, blob, &length, &version);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // Unversioned blob from before records, same layout as version 1, rewritten as a record below
+        err = nvs_get_blob(s_scheduler_nvs_handle, SCHEDULER_JOB_KEY, blob, &length);
+        is_legacy = err == ESP_OK;
+        version = 1;
+    }
+    if (err == ESP_OK) {
+        err = scheduler_load_jobs(blob, length, version);
+    }
+    free(blob);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Failed to load jobs: %s", esp_err_to_name(err));
+    }
+    ESP_LOGI(TAG, "Loaded %d jobs", s_heap_len);
+    if (err == ESP_OK && version != SCHEDULER_RECORD_VERSION && scheduler_persist() == ESP_OK) {
+        record_count_migrated();
+        if (is_legacy) {
+            nvs_erase_key(s_scheduler_nvs_handle, SCHEDULER_JOB_KEY);
+            nvs_commit(s_scheduler_nvs_handle);
+        }
+    }
+
+    if (mem_task_create(&scheduler_task, "SCHEDULER_TASK", SCHEDULER_STACK_SIZE, NULL, 2, &s_scheduler_task_handle, 1,
+                        MEM_TASK_STACK(s_scheduler_task), MEM_TASK_TCB(s_scheduler_task)) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+esp_err_t scheduler_add_job(const char *spec, uint16_t *job_id)
+{
+    scheduler_job_t job;
+    esp_err_t err = scheduler_parse_spec(spec, &job);
+    if (err != ESP_OK)
+        return err;
+
+    xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+    uint16_t id;
+    for (id = 0; id < SCHEDULER_MAX_JOB && s_job_array[id].in_use; id++);
+    if (id == SCHEDULER_MAX_JOB) {
+        xSemaphoreGive(s_scheduler_mutex);
+        return ESP_ERR_NO_MEM;
+    }
+    s_job_array[id] = job;
+    heap_push(id);
+    err = scheduler_persist();
+    xSemaphoreGive(s_scheduler_mutex);
+    xTaskNotifyGive(s_scheduler_task_handle);
+    if (job_id != NULL) {
+        *job_id = id;
+    }
+    return err;
+}
+
+esp_err_t scheduler_update_job(uint16_t job_id, const char *spec)
+{
+    scheduler_job_t job;
+    if (job_id >= SCHEDULER_MAX_JOB)
+        return ESP_ERR_INVALID_ARG;
+    esp_err_t err = scheduler_parse_spec(spec, &job);
+    if (err != ESP_OK)
+        return err;
+
+    xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+    if (!s_job_array[job_id].in_use) {
+        xSemaphoreGive(s_scheduler_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_job_array[job_id] = job;
+    heap_sift_down(s_heap_pos[job_id]);
+    heap_sift_up(s_heap_pos[job_id]);
+    err = scheduler_persist();
+    xSemaphoreGive(s_scheduler_mutex);
+    xTaskNotifyGive(s_scheduler_task_handle);
+    return err;
+}
+
+esp_err_t scheduler_delete_job(uint16_t job_id)
+{
+    if (job_id >= SCHEDULER_MAX_JOB)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+    if (!s_job_array[job_id].in_use) {
+        xSemaphoreGive(s_scheduler_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    heap_remove(job_id);
+    s_job_array[job_id].in_use = 0;
+    esp_err_t err = scheduler_persist();
+    xSemaphoreGive(s_scheduler_mutex);
+    xTaskNotifyGive(s_scheduler_task_handle);
+    return err;
+}
+
+esp_err_t scheduler_get_job(uint16_t job_id, scheduler_job_t *job)
+{
+    if (job_id >= SCHEDULER_MAX_JOB)
+        return ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+    *job = s_job_array[job_id];
+    xSemaphoreGive(s_scheduler_mutex);
+    return job->in_use ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t scheduler_encode_job(uint16_t job_id, uint8_t *out)
+{
+    scheduler_job_t job;
+    esp_err_t err = scheduler_get_job(job_id, &job);
+    if (err != ESP_OK)
+        return err;
+    scheduler_encode(job_id, &job, out);
+    return ESP_OK;
+}
+
+esp_err_t scheduler_load(const uint8_t *payload, size_t length, uint16_t version)
+{
+    xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+    esp_err_t err = scheduler_load_jobs(payload, length, version);
+    if (err == ESP_OK) {
+        err = scheduler_persist();
+    }
+    xSemaphoreGive(s_scheduler_mutex);
+    xTaskNotifyGive(s_scheduler_task_handle);
+    return err;
+}
+
+// Jobs keep their absolute next run time, only HH:MM specs given afterwards use the new zone
+esp_err_t scheduler_set_timezone(const char *timezone)
+{
+    if (strlen(timezone) == 0 || strlen(timezone) >= SCHEDULER_TZ_LEN)
+        return ESP_ERR_INVALID_ARG;
+    esp_err_t err = nvs_set_str(s_scheduler_nvs_handle, SCHEDULER_TZ_KEY, timezone);
+    if (err == ESP_OK) {
+        err = nvs_commit(s_scheduler_nvs_handle);
+    }
+    if (err != ESP_OK)
+        return err;
+    xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+    strcpy(s_timezone, timezone);
+    setenv("TZ", s_timezone, 1);
+    tzset();
+    xSemaphoreGive(s_scheduler_mutex);
+    return ESP_OK;
+}
+
+void scheduler_get_timezone(char *timezone, size_t length)
+{
+    xSemaphoreTake(s_scheduler_mutex, portMAX_DELAY);
+    snprintf(timezone, length, "%s", s_timezone);
+    xSemaphoreGive(s_scheduler_mutex);
+}
\ No newline at end of file
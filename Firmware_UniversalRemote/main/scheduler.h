@@ -0,0 +1,52 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define SCHEDULER_NAMESPACE         "sched_storage"
+#define SCHEDULER_JOB_KEY           "sched_jobs"
+#define SCHEDULER_TZ_KEY            "sched_tz"
+#define SCHEDULER_RECORD_VERSION    2
+
+#define SCHEDULER_NTP_SERVER        "pool.ntp.org"
+// POSIX TZ string used until one is set with scheduler_set_timezone
+#define SCHEDULER_DEFAULT_TIMEZONE  "UTC0"
+#define SCHEDULER_TZ_LEN            64
+#define SCHEDULER_MAX_JOB           256
+#define SCHEDULER_MAX_WAIT_S        60
+#define SCHEDULER_MISS_GRACE_S      300
+#define SCHEDULER_MIN_VALID_TIME    1700000000
+#define SCHEDULER_STACK_SIZE        3072
+#define SCHEDULER_JOB_RECORD_LEN    16
+// Version 1 records had no job id, their jobs get ids in stored order when they are loaded
+#define SCHEDULER_JOB_RECORD_LEN_V1 14
+
+typedef struct {
+    uint8_t in_use;
+    uint8_t ir_remote_id;
+    uint8_t ir_code_id;
+    uint32_t period_s;
+    int64_t next_s;
+} scheduler_job_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t scheduler_init(void);
+esp_err_t scheduler_add_job(const char *spec, uint16_t *job_id);
+esp_err_t scheduler_update_job(uint16_t job_id, const char *spec);
+esp_err_t scheduler_delete_job(uint16_t job_id);
+esp_err_t scheduler_get_job(uint16_t job_id, scheduler_job_t *job);
+esp_err_t scheduler_encode_job(uint16_t job_id, uint8_t *out);
+esp_err_t scheduler_load(const uint8_t *payload, size_t length, uint16_t version);
+esp_err_t scheduler_set_timezone(const char *timezone);
+void scheduler_get_timezone(char *timezone, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
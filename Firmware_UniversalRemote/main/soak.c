@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "soak.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "nvs.h"
+#include "ir_manage.h"
+#include "wifi_connect.h"
+#include "mem_budget.h"
+
+static const char *TAG = "SOAK";
+
+typedef struct {
+    const char *name;
+    uint8_t weight;
+    uint32_t p99_budget_ms;     // 0 leaves latency unchecked
+    uint8_t is_error_checked;
+} soak_op_rule_t;
+
+// Mostly key presses and page loads, learning only starts a session and is not judged by its outcome
+static const soak_op_rule_t s_op_rule_array[SOAK_NUM_OP] = {
+    [SOAK_OP_SEND]  = {"send",  60, 1000, 1},
+    [SOAK_OP_PAGE]  = {"page",  25, 2000, 1},
+    [SOAK_OP_SAVE]  = {"save",   8, 500,  1},
+    [SOAK_OP_LEARN] = {"learn",  4, 0,    0},
+    [SOAK_OP_WIFI]  = {"wifi",   3, 200,  1},
+};
+
+static const char *s_page_path_array[] = {"/", "/tv/%d", "/ac/%d", "/favicon.ico"};
+
+static TaskHandle_t s_soak_task_handle;
+static volatile uint8_t s_is_running;
+static volatile esp_err_t s_send_err;
+// Sends carry their sequence number, the task only ends once the last one issued has called back
+static volatile uint32_t s_send_seq;
+static volatile uint32_t s_done_seq;
+static uint8_t s_ir_remote_id;
+static uint32_t s_seed;
+static uint32_t s_rng;
+static uint32_t s_virtual_s;
+static uint32_t s_target_s;
+static uint32_t s_real_s;
+static uint32_t s_sample_period_s;
+static uint32_t s_next_sample_s;
+static soak_op_stats_t s_op_stats[SOAK_NUM_OP];
+static uint32_t s_bin_array[SOAK_NUM_OP][SOAK_NUM_BIN];
+static soak_sample_t s_sample_array[SOAK_MAX_SAMPLE];
+static uint16_t s_num_sample;
+// Codes and info of the soak remote before the run, learn sessions overwrite keys and are undone at the end
+static IRMP_DATA s_saved_code_array[IR_TV_NUM_CODE];
+static char s_saved_info[IR_INFO_LEN];
+
+// xorshift32, a seed replays the same sequence of operations
+static uint32_t soak_random(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static soak_op_t soak_pick_op(void)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < SOAK_NUM_OP; i++) {
+        total += s_op_rule_array[i].weight;
+    }
+    uint32_t pick = soak_random() % total;
+    for (int i = 0; i < SOAK_NUM_OP; i++) {
+        if (pick < s_op_rule_array[i].weight)
+            return i;
+        pick -= s_op_rule_array[i].weight;
+    }
+    return SOAK_OP_SEND;
+}
+
+// Four bins per power of two from 64 us, so a percentile is within 25% of the true value
+static uint8_t soak_get_bin(uint32_t us)
+{
+    if (us < 64)
+        return 0;
+    int msb = 31 - __builtin_clz(us);
+    uint32_t bin = (msb - 6) * 4 + ((us >> (msb - 2)) & 3) + 1;
+    return bin < SOAK_NUM_BIN ? bin : SOAK_NUM_BIN - 1;
+}
+
+static uint32_t soak_get_bin_limit_us(uint8_t bin)
+{
+    if (bin == 0)
+        return 64;
+    return (5 + (bin - 1) % 4) << ((bin - 1) / 4 + 4);
+}
+
+static uint32_t soak_get_percentile_us(soak_op_t op, uint8_t pct)
+{
+    uint32_t target = ((s_op_stats[op].count - s_op_stats[op].num_error) * pct + 99) / 100;
+    uint32_t sum = 0;
+    for (int i = 0; i < SOAK_NUM_BIN && target; i++) {
+        sum += s_bin_array[op][i];
+        if (sum >= target) {
+            uint32_t limit_us = soak_get_bin_limit_us(i);
+            return limit_us < s_op_stats[op].max_us && i < SOAK_NUM_BIN - 1 ? limit_us : s_op_stats[op].max_us;
+        }
+    }
+    return 0;
+}
+
+static void soak_send_done(uint8_t ir_code_id, uint8_t ir_remote_id, esp_err_t err, int64_t queued_us, void *ctx)
+{
+    s_send_err = err;
+    s_done_seq = (uint32_t) (uintptr_t) ctx;
+    TaskHandle_t handle = s_soak_task_handle;
+    if (handle) {
+        xTaskNotifyGive(handle);
+    }
+}
+
+// A send that timed out may still call back later, wait for it rather than count its result twice
+static esp_err_t soak_wait_send(uint32_t timeout_ms)
+{
+    TickType_t start_tick = xTaskGetTickCount();
+    while (s_done_seq != s_send_seq)
+    {
+        TickType_t elapsed = xTaskGetTickCount() - start_tick;
+        if (elapsed >= pdMS_TO_TICKS(timeout_ms) || ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms) - elapsed) == 0)
+            return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+// Queued like a web or MQTT key press, the latency covers the wait in the TX queue
+static esp_err_t soak_send(void)
+{
+    uint8_t ir_code_id = soak_random() % IR_TV_NUM_CODE;
+    for (int i = 0; i < IR_TV_NUM_CODE && !ir_is_learned_tv(ir_code_id, s_ir_remote_id); i++) {
+        ir_code_id = (ir_code_id + 1) % IR_TV_NUM_CODE;
+    }
+    if (!ir_is_learned_tv(ir_code_id, s_ir_remote_id))
+        return ESP_ERR_NOT_FOUND;
+    if (soak_wait_send(SOAK_SEND_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_TIMEOUT;
+    uint32_t seq = s_send_seq + 1;
+    s_send_seq = seq;
+    esp_err_t err = ir_send_code_tv_async(ir_code_id, s_ir_remote_id, IR_TX_SOURCE_OTHER, soak_send_done, (void *) (uintptr_t) seq);
+    if (err != ESP_OK) {
+        s_done_seq = seq;
+        return err;
+    }
+    if (soak_wait_send(SOAK_SEND_TIMEOUT_MS) != ESP_OK)
+        return ESP_ERR_TIMEOUT;
+    return s_send_err;
+}
+
+// A new connection per page, like a phone opening the remote
+static esp_err_t soak_page(void)
+{
+    char path[32];
+    char url[64];
+    snprintf(path, sizeof(path), s_page_path_array[soak_random() % (sizeof(s_page_path_array) / sizeof(s_page_path_array[0]))],
+             s_ir_remote_id + 1);
+    snprintf(url, sizeof(url), "%s%s", SOAK_PAGE_URL, path);
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = SOAK_PAGE_TIMEOUT_MS,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL)
+        return ESP_ERR_NO_MEM;
+    // Remote pages answer 404 in AP mode, that is a skip rather than a failure
+    esp_err_t err = esp_http_client_perform(client);
+    if (err == ESP_OK && esp_http_client_get_status_code(client) == 404) {
+        err = ESP_ERR_NOT_FOUND;
+    } else if (err == ESP_OK && esp_http_client_get_status_code(client) != 200) {
+        err = ESP_FAIL;
+    }
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+// Starts a learn session on the soak remote and waits it out, a stray IR frame is stored until soak_restore
+static esp_err_t soak_learn(uint32_t *settle_ms)
+{
+    esp_err_t err = ir_add_code_tv_detect(soak_random() % IR_TV_NUM_CODE, s_ir_remote_id);
+    if (err == ESP_OK) {
+        *settle_ms = IR_RECEIVE_PERIOD_MS + 500;
+    }
+    return err;
+}
+
+// Same path as the web form, the current credentials are written to NVS again and the station reconnects
+static esp_err_t soak_wifi(uint32_t *settle_ms)
+{
+    wifi_config_t wifi_config;
+    char ssid[MAX_WIFI_SSID_LENGTH + 1];
+    char pwd[MAX_WIFI_PWD_LENGTH + 1];
+    if (get_wifi_mode() != WIFI_MODE_STA)
+        return ESP_ERR_INVALID_STATE;
+    esp_err_t err = esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+    if (err != ESP_OK)
+        return err;
+    snprintf(ssid, sizeof(ssid), "%.*s", MAX_WIFI_SSID_LENGTH, (char *) wifi_config.sta.ssid);
+    snprintf(pwd, sizeof(pwd), "%.*s", MAX_WIFI_PWD_LENGTH, (char *) wifi_config.sta.password);
+    *settle_ms = 1000;
+    return set_wifi(ssid, pwd);
+}
+
+static esp_err_t soak_run_op(soak_op_t op, uint32_t *settle_ms)
+{
+    switch (op) {
+    case SOAK_OP_SEND:
+        return soak_send();
+    case SOAK_OP_PAGE:
+        return soak_page();
+    case SOAK_OP_SAVE:
+        return ir_commit_tv(s_ir_remote_id);
+    case SOAK_OP_LEARN:
+        return soak_learn(settle_ms);
+    case SOAK_OP_WIFI:
+        return soak_wifi(settle_ms);
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+// Nothing to act on (no learned key, not a station) is a skip, not an error
+static void soak_record(soak_op_t op, esp_err_t err, uint32_t latency_us)
+{
+    soak_op_stats_t *stats = &s_op_stats[op];
+    if (err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_STATE) {
+        stats->num_skip++;
+        return;
+    }
+    stats->count++;
+    if (err != ESP_OK) {
+        stats->num_error++;
+        return;
+    }
+    s_bin_array[op][soak_get_bin(latency_us)]++;
+    if (latency_us > stats->max_us) {
+        stats->max_us = latency_us;
+    }
+}
+
+// When the buffer is full every other sample is dropped and the period doubles, so any run length fits
+static void soak_take_sample(void)
+{
+    mem_heap_info_t heap;
+    nvs_stats_t nvs_stats = {0};
+    mem_get_heap(MEM_HEAP_INTERNAL, &heap);
+    nvs_get_stats(NULL, &nvs_stats);
+    if (s_num_sample == SOAK_MAX_SAMPLE) {
+        for (int i = 0; i < SOAK_MAX_SAMPLE / 2; i++) {
+            s_sample_array[i] = s_sample_array[i * 2];
+        }
+        s_num_sample = SOAK_MAX_SAMPLE / 2;
+        s_sample_period_s *= 2;
+    }
+    s_sample_array[s_num_sample++] = (soak_sample_t) {
+        .virtual_s = s_virtual_s,
+        .free_bytes = heap.free_bytes,
+        .min_free_bytes = heap.min_free_bytes,
+        .largest_block = heap.largest_block,
+        .fragmentation_pct = heap.fragmentation_pct,
+        .nvs_used_entry = nvs_stats.used_entries,
+    };
+}
+
+// Least squares slope per virtual hour of a sample field, over the samples after the warmup
+static int32_t soak_get_slope_per_h(size_t offset)
+{
+    double n = 0, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    for (int i = 0; i < s_num_sample; i++) {
+        if (s_sample_array[i].virtual_s < SOAK_WARMUP_S) {
+            continue;
+        }
+        double x = s_sample_array[i].virtual_s / 3600.0;
+        double y = *(const uint32_t *) ((const uint8_t *) &s_sample_array[i] + offset);
+        n++;
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+    double denominator = n * sum_xx - sum_x * sum_x;
+    if (n < 2 || denominator <= 0)
+        return 0;
+    return (int32_t) ((n * sum_xy - sum_x * sum_y) / denominator);
+}
+
+static void soak_add_reason(soak_report_t *report, const char *format, const char *name, long value)
+{
+    if (report->num_reason < SOAK_MAX_REASON) {
+        snprintf(report->reason_array[report->num_reason++], SOAK_REASON_LEN, format, name, value);
+    }
+}
+
+static void soak_evaluate(soak_report_t *report)
+{
+    report->num_reason = 0;
+    for (int i = 0; i < SOAK_NUM_OP; i++) {
+        const soak_op_rule_t *rule = &s_op_rule_array[i];
+        const soak_op_stats_t *stats = &report->op_stats[i];
+        if (rule->p99_budget_ms && stats->p99_us > rule->p99_budget_ms * 1000) {
+            soak_add_reason(report, "%s p99 %ld ms", rule->name, stats->p99_us / 1000);
+        }
+        if (rule->is_error_checked && stats->num_error * 100 > stats->count * SOAK_BUDGET_ERROR_PCT) {
+            soak_add_reason(report, "%s errors %ld", rule->name, stats->num_error);
+        }
+    }
+    if (report->heap_per_h < -SOAK_BUDGET_HEAP_LOSS_PER_H) {
+        soak_add_reason(report, "%s %ld B/h", "heap free", report->heap_per_h);
+    }
+    if (report->largest_per_h < -SOAK_BUDGET_LARGEST_LOSS_PER_H) {
+        soak_add_reason(report, "%s %ld B/h", "largest block", report->largest_per_h);
+    }
+    if (report->max_fragmentation_pct > SOAK_BUDGET_FRAG_PCT) {
+        soak_add_reason(report, "%s %ld%%", "fragmentation", report->max_fragmentation_pct);
+    }
+    if (report->nvs_entry_per_h > SOAK_BUDGET_NVS_ENTRY_PER_H) {
+        soak_add_reason(report, "%s +%ld entries/h", "NVS", report->nvs_entry_per_h);
+    }
+}
+
+static void soak_restore(void)
+{
+    for (int i = 0; i < IR_TV_NUM_CODE; i++) {
+        ir_add_code_tv(s_saved_code_array[i], i, s_ir_remote_id);
+    }
+    ir_add_code_info_tv(s_saved_info, s_ir_remote_id);
+    if (ir_commit_tv(s_ir_remote_id) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to restore TV remote %d", s_ir_remote_id + 1);
+    }
+}
+
+static void soak_task(void *args)
+{
+    int64_t start_us = esp_timer_get_time();
+    soak_report_t report;
+    soak_take_sample();
+    while (s_is_running && s_virtual_s < s_target_s)
+    {
+        uint32_t settle_ms = 0;
+        soak_op_t op = soak_pick_op();
+        int64_t op_start_us = esp_timer_get_time();
+        esp_err_t err = soak_run_op(op, &settle_ms);
+        soak_record(op, err, esp_timer_get_time() - op_start_us);
+        if (settle_ms) {
+            vTaskDelay(pdMS_TO_TICKS(settle_ms));
+        }
+        s_virtual_s += soak_random() % (2 * SOAK_MEAN_GAP_S + 1);
+        if (s_virtual_s >= s_next_sample_s) {
+            soak_take_sample();
+            s_next_sample_s += s_sample_period_s;
+        }
+        s_real_s = (esp_timer_get_time() - start_us) / 1000000;
+        vTaskDelay(1);
+    }
+    soak_take_sample();
+    while (soak_wait_send(SOAK_SEND_TIMEOUT_MS) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Waiting for the last send");
+    }
+    soak_restore();
+    s_is_running = 0;
+    soak_get_report(&report);
+    if (report.num_reason) {
+        ESP_LOGE(TAG, "Soak failed after %lu virtual s, first reason: %s", (unsigned long) report.virtual_s, report.reason_array[0]);
+    } else {
+        ESP_LOGI(TAG, "Soak passed after %lu virtual s", (unsigned long) report.virtual_s);
+    }
+    s_soak_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t soak_start(uint8_t ir_remote_id, uint32_t virtual_h, uint32_t seed)
+{
+    if (ir_remote_id >= IR_TV_NUM_REMOTE || virtual_h == 0)
+        return ESP_ERR_INVALID_ARG;
+    if (s_soak_task_handle)
+        return ESP_ERR_INVALID_STATE;
+    for (int i = 0; i < IR_TV_NUM_CODE; i++) {
+        if (ir_get_code_tv(i, ir_remote_id, &s_saved_code_array[i]) != ESP_OK)
+            return ESP_FAIL;
+    }
+    snprintf(s_saved_info, sizeof(s_saved_info), "%s", ir_get_code_info_tv(ir_remote_id));
+    memset(s_op_stats, 0, sizeof(s_op_stats));
+    memset(s_bin_array, 0, sizeof(s_bin_array));
+    s_num_sample = 0;
+    s_ir_remote_id = ir_remote_id;
+    s_seed = seed ? seed : 1;
+    s_rng = s_seed;
+    s_virtual_s = 0;
+    s_real_s = 0;
+    s_target_s = virtual_h * 3600;
+    s_sample_period_s = SOAK_SAMPLE_PERIOD_S;
+    s_next_sample_s = SOAK_SAMPLE_PERIOD_S;
+    s_is_running = 1;
+    // HTTP clients and IR sends compete with httpd and the esp_timer task on core 0, like real traffic
+    if (xTaskCreatePinnedToCore(&soak_task, "SOAK_TASK", SOAK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, &s_soak_task_handle, 0) != pdPASS) {
+        s_is_running = 0;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// The current operation finishes first, the result stays available in the report
+void soak_stop(void)
+{
+    s_is_running = 0;
+}
+
+const char *soak_get_op_name(soak_op_t op)
+{
+    return op < SOAK_NUM_OP ? s_op_rule_array[op].name : "";
+}
+
+esp_err_t soak_get_report(soak_report_t *report)
+{
+    memset(report, 0, sizeof(*report));
+    report->is_running = s_is_running;
+    report->seed = s_seed;
+    report->virtual_s = s_virtual_s;
+    report->target_s = s_target_s;
+    report->real_s = s_real_s;
+    for (int i = 0; i < SOAK_NUM_OP; i++) {
+        report->op_stats[i] = s_op_stats[i];
+        report->op_stats[i].p50_us = soak_get_percentile_us(i, 50);
+        report->op_stats[i].p95_us = soak_get_percentile_us(i, 95);
+        report->op_stats[i].p99_us = soak_get_percentile_us(i, 99);
+    }
+    report->num_sample = s_num_sample;
+    if (s_num_sample == 0)
+        return ESP_OK;
+    report->first = s_sample_array[0];
+    report->last = s_sample_array[s_num_sample - 1];
+    report->heap_per_h = soak_get_slope_per_h(offsetof(soak_sample_t, free_bytes));
+    report->largest_per_h = soak_get_slope_per_h(offsetof(soak_sample_t, largest_block));
+    report->nvs_entry_per_h = soak_get_slope_per_h(offsetof(soak_sample_t, nvs_used_entry));
+    for (int i = 0; i < s_num_sample; i++) {
+        if (s_sample_array[i].virtual_s >= SOAK_WARMUP_S && s_sample_array[i].fragmentation_pct > report->max_fragmentation_pct) {
+            report->max_fragmentation_pct = s_sample_array[i].fragmentation_pct;
+        }
+    }
+    soak_evaluate(report);
+    return ESP_OK;
+}
+
+esp_err_t soak_get_sample(uint16_t index, soak_sample_t *sample)
+{
+    if (index >= s_num_sample)
+        return ESP_ERR_NOT_FOUND;
+    *sample = s_sample_array[index];
+    return ESP_OK;
+}
\ No newline at end of file
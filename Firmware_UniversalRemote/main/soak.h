@@ -0,0 +1,93 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Replays a household's traffic back to back. Each operation advances a virtual clock by a random gap with
+ * mean SOAK_MEAN_GAP_S, so hours of use pass in minutes and heap and NVS trends are measured per virtual hour.
+ * A run writes to the device: learn sessions change the soak remote until its codes and info are restored at
+ * the end, and the Wi-Fi operation saves the current credentials to NVS again. A reset during the run skips the
+ * restore, so use a remote that can be relearned.
+ */
+#define SOAK_MEAN_GAP_S             30
+#define SOAK_SAMPLE_PERIOD_S        600
+#define SOAK_WARMUP_S               3600
+#define SOAK_MAX_SAMPLE             128
+#define SOAK_NUM_BIN                64
+#define SOAK_MAX_REASON             8
+#define SOAK_REASON_LEN             48
+#define SOAK_STACK_SIZE             4096
+#define SOAK_PAGE_URL               "http://127.0.0.1"
+#define SOAK_PAGE_TIMEOUT_MS        5000
+#define SOAK_SEND_TIMEOUT_MS        2000
+
+// Budgets checked once the warmup is over, a run fails when any of them is exceeded
+#define SOAK_BUDGET_HEAP_LOSS_PER_H 512
+#define SOAK_BUDGET_LARGEST_LOSS_PER_H 512
+#define SOAK_BUDGET_FRAG_PCT        50
+#define SOAK_BUDGET_NVS_ENTRY_PER_H 2
+#define SOAK_BUDGET_ERROR_PCT       1
+
+typedef enum {
+    SOAK_OP_SEND,
+    SOAK_OP_PAGE,
+    SOAK_OP_SAVE,
+    SOAK_OP_LEARN,
+    SOAK_OP_WIFI,
+    SOAK_NUM_OP,
+} soak_op_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t num_error;
+    uint32_t num_skip;
+    uint32_t max_us;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+} soak_op_stats_t;
+
+typedef struct {
+    uint32_t virtual_s;
+    uint32_t free_bytes;
+    uint32_t min_free_bytes;
+    uint32_t largest_block;
+    uint8_t fragmentation_pct;
+    uint32_t nvs_used_entry;
+} soak_sample_t;
+
+typedef struct {
+    uint8_t is_running;
+    uint32_t seed;
+    uint32_t virtual_s;
+    uint32_t target_s;
+    uint32_t real_s;
+    soak_op_stats_t op_stats[SOAK_NUM_OP];
+    uint16_t num_sample;
+    soak_sample_t first;
+    soak_sample_t last;
+    int32_t heap_per_h;
+    int32_t largest_per_h;
+    int32_t nvs_entry_per_h;
+    uint8_t max_fragmentation_pct;
+    uint8_t num_reason;
+    char reason_array[SOAK_MAX_REASON][SOAK_REASON_LEN];
+} soak_report_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t soak_start(uint8_t ir_remote_id, uint32_t virtual_h, uint32_t seed);
+void soak_stop(void);
+const char *soak_get_op_name(soak_op_t op);
+esp_err_t soak_get_report(soak_report_t *report);
+esp_err_t soak_get_sample(uint16_t index, soak_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
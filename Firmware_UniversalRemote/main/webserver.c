@@ -2,7 +2,16 @@
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "ir_manage.h"
+#include "ir_key.h"
+#include "ir_sweep.h"
+#include "ir_backup.h"
+#include "fleet_sync.h"
+#include "scheduler.h"
 #include "wifi_connect.h"
+#include "boot.h"
+#include "rate_limit.h"
+#include "mem_budget.h"
+#include "lwip/sockets.h"
 
 static const char *TAG = "WEBSERVER";
 
@@ -51,8 +60,40 @@ static esp_err_t url_decode(char *in, char *out)
     return ESP_OK;
 }
 
+// Answers a rejected request itself, the handler returns right away when this fails
+static esp_err_t http_admit(httpd_req_t *req, rate_limit_class_t limit_class)
+{
+    struct sockaddr_in6 addr;
+    socklen_t addr_len = sizeof(addr);
+    uint8_t client_addr[RATE_LIMIT_ADDR_LEN] = {0};
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *) &addr, &addr_len) == 0) {
+        if (addr.sin6_family == AF_INET6) {
+            memcpy(client_addr, addr.sin6_addr.s6_addr, sizeof(client_addr));
+        } else {
+            // IPv4 peers as ::ffff:a.b.c.d so both families share one table
+            client_addr[10] = 0xff;
+            client_addr[11] = 0xff;
+            memcpy(client_addr + 12, &((struct sockaddr_in *) &addr)->sin_addr, 4);
+        }
+    }
+
+    uint32_t retry_after_s = 0;
+    rate_limit_result_t result = rate_limit_admit(client_addr, limit_class, &retry_after_s);
+    if (result == RATE_LIMIT_ADMIT) {
+        return ESP_OK;
+    }
+    char retry_after[12];
+    snprintf(retry_after, sizeof(retry_after), "%lu", (unsigned long) retry_after_s);
+    httpd_resp_set_status(req, result == RATE_LIMIT_THROTTLE ? "429 Too Many Requests" : "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", retry_after);
+    httpd_resp_send(req, NULL, 0);
+    return ESP_FAIL;
+}
+
 static esp_err_t http_resp_favicon(httpd_req_t *req)
 {
+    if (http_admit(req, RATE_LIMIT_CLASS_PAGE) != ESP_OK)
+        return ESP_OK;
     extern const unsigned char favicon_ico_start[] asm("_binary_favicon_ico_start");
     extern const unsigned char favicon_ico_end[]   asm("_binary_favicon_ico_end");
     const size_t favicon_ico_size = favicon_ico_end - favicon_ico_start;
@@ -63,6 +104,8 @@ static esp_err_t http_resp_favicon(httpd_req_t *req)
 
 static esp_err_t http_resp_root(httpd_req_t *req) 
 {   
+    if (http_admit(req, RATE_LIMIT_CLASS_PAGE) != ESP_OK)
+        return ESP_OK;
     httpd_resp_set_status(req, "307 Temporary Redirect");
     if (get_wifi_mode() == WIFI_MODE_AP) {
         httpd_resp_set_hdr(req, "Location", "/wifi");
@@ -75,6 +118,8 @@ static esp_err_t http_resp_root(httpd_req_t *req)
 
 static esp_err_t http_resp_tv_remote(httpd_req_t *req) 
 {   
+    if (http_admit(req, RATE_LIMIT_CLASS_PAGE) != ESP_OK)
+        return ESP_OK;
     if (get_wifi_mode() != WIFI_MODE_STA) {
         httpd_resp_send_404(req);
         return ESP_FAIL;
@@ -95,8 +140,32 @@ static esp_err_t http_resp_tv_remote(httpd_req_t *req)
     return ESP_FAIL;
 }
 
+// Rejects bodies that do not fit with 400, buf is NUL terminated
+static esp_err_t http_recv_body(httpd_req_t *req, char *buf, size_t length)
+{
+    int ret, received = 0;
+    if (req->content_len >= length) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too long");
+        return ESP_FAIL;
+    }
+    while (received < req->content_len)
+    {
+        if ((ret = httpd_req_recv(req, buf + received, req->content_len - received)) <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    buf[received] = '\0';
+    return ESP_OK;
+}
+
 static esp_err_t http_resp_tv_remote_command(httpd_req_t *req) 
 {
+    if (http_admit(req, RATE_LIMIT_CLASS_IR) != ESP_OK)
+        return ESP_OK;
     if (get_wifi_mode() != WIFI_MODE_STA) {
         httpd_resp_send_404(req);
         return ESP_FAIL;
@@ -107,33 +176,342 @@ static esp_err_t http_resp_tv_remote_command(httpd_req_t *req)
     
     long ir_code = 0;
     static char buf[32];
+    if (http_recv_body(req, buf, sizeof(buf)) != ESP_OK)
+        return ESP_FAIL;
+
+    ir_code = strtol(buf, NULL, 10);
+    esp_err_t err;
+    if (strcmp(req->user_ctx, "command") == 0) {
+        ESP_LOGI(TAG, "Sending IR code");
+        err = ir_send_code_tv_async(ir_code, num_dev, IR_TX_SOURCE_WEB, NULL, NULL);
+    } else {
+        ESP_LOGI(TAG, "Adding IR code");
+        err = ir_add_code_tv_detect(ir_code, num_dev);
+    }    
+    if (err == ESP_ERR_NO_MEM) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+    }
+    httpd_resp_send(req, NULL, 0);
+    memset(buf, '\0', sizeof(buf));
+    return ESP_OK;
+}
+
+static esp_err_t http_resp_tv_sweep(httpd_req_t *req)
+{
+    if (http_admit(req, RATE_LIMIT_CLASS_IR) != ESP_OK)
+        return ESP_OK;
+    if (get_wifi_mode() != WIFI_MODE_STA) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    esp_err_t err;
+    if (strcmp(req->user_ctx, "start") == 0) {
+        char *pch =strrchr(req->uri,'/');
+        long num_dev = strtol(pch + 1, NULL, 10) - 1;
+        ESP_LOGI(TAG, "Starting IR sweep");
+        err = ir_sweep_start_tv(num_dev);
+    } else if (strcmp(req->user_ctx, "confirm") == 0) {
+        err = ir_sweep_confirm();
+    } else {
+        err = ir_sweep_stop();
+    }
+
+    if (err != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+    }
+    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
+}
+
+static esp_err_t http_backup_write_chunk(const uint8_t *data, size_t length, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *) ctx, (const char *) data, length);
+}
+
+static esp_err_t http_resp_backup(httpd_req_t *req)
+{
+    if (http_admit(req, RATE_LIMIT_CLASS_API) != ESP_OK)
+        return ESP_OK;
+    if (get_wifi_mode() != WIFI_MODE_STA) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    if (req->method == HTTP_GET) {
+        httpd_resp_set_type(req, "application/octet-stream");
+        httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"remote.irbk\"");
+        if (ir_backup_export(http_backup_write_chunk, req) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        httpd_resp_send_chunk(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    // Restores overwrite every remote, only a holder of the fleet sync key may push one
+    char key[FLEET_SYNC_KEY_LEN];
+    if (httpd_req_get_hdr_value_str(req, FLEET_SYNC_KEY_HEADER, key, sizeof(key)) != ESP_OK || !fleet_sync_is_authorized(key)) {
+        httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Invalid sync key");
+        return ESP_FAIL;
+    }
+    ir_backup_import_t *import = ir_backup_import_begin();
+    if (import == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+    char buf[256];
     int ret, remaining = req->content_len;
-    while (remaining > 0) 
+    while (remaining > 0)
     {
-        if ((ret = httpd_req_recv(req, buf, (remaining > sizeof(buf) ? remaining : sizeof(buf)))) <= 0) {
+        if ((ret = httpd_req_recv(req, buf, (remaining < sizeof(buf) ? remaining : sizeof(buf)))) <= 0) {
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 continue;
             }
-        return ESP_FAIL;
+            ir_backup_import_abort(import);
+            return ESP_FAIL;
+        }
+        if (ir_backup_import_feed(import, (const uint8_t *) buf, ret) != ESP_OK) {
+            ir_backup_import_abort(import);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid backup");
+            return ESP_FAIL;
         }
         remaining -= ret;
     }
+    if (ir_backup_import_finish(import) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid backup");
+        return ESP_FAIL;
+    }
+    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
+}
 
-    ir_code = strtol(buf, NULL, 10);
-    if (strcmp(req->user_ctx, "command") == 0) {
-        ESP_LOGI(TAG, "Sending IR code");
-        ir_send_code_tv(ir_code, num_dev); 
+static esp_err_t http_resp_sync_manifest(httpd_req_t *req)
+{
+    if (http_admit(req, RATE_LIMIT_CLASS_API) != ESP_OK)
+        return ESP_OK;
+    char manifest[FLEET_SYNC_MANIFEST_LEN];
+    if (fleet_sync_get_manifest(manifest, sizeof(manifest)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_sendstr(req, manifest);
+    return ESP_OK;
+}
+
+static esp_err_t http_resp_schedule(httpd_req_t *req)
+{
+    if (http_admit(req, RATE_LIMIT_CLASS_API) != ESP_OK)
+        return ESP_OK;
+    char buf[64];
+    esp_err_t err;
+    scheduler_job_t job;
+
+    if (req->method == HTTP_GET) {
+        uint8_t is_first = 1;
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr_chunk(req, "[");
+        for (int i = 0; i < SCHEDULER_MAX_JOB; i++) {
+            if (scheduler_get_job(i, &job) != ESP_OK) {
+                continue;
+            }
+            snprintf(buf, sizeof(buf), "%s{\"id\":%d,\"remote\":%d,\"code\":%d,\"next\":%lld,\"period\":%lu}",
+                    is_first ? "" : ",", i, job.ir_remote_id, job.ir_code_id, (long long) job.next_s, (unsigned long) job.period_s);
+            httpd_resp_sendstr_chunk(req, buf);
+            is_first = 0;
+        }
+        httpd_resp_sendstr_chunk(req, "]");
+        httpd_resp_sendstr_chunk(req, NULL);
+        return ESP_OK;
+    }
+
+    long job_id = -1;
+    if (strcmp(req->uri, "/schedule") != 0) {
+        char *pch = strrchr(req->uri, '/') + 1;
+        char *end;
+        job_id = strtol(pch, &end, 10);
+        if (end == pch || *end != '\0' || job_id < 0 || job_id >= SCHEDULER_MAX_JOB) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid job id");
+            return ESP_OK;
+        }
+    }
+    if (req->method == HTTP_DELETE) {
+        err = scheduler_delete_job(job_id);
     } else {
-        ESP_LOGI(TAG, "Adding IR code");
-        ir_add_code_tv_detect(ir_code, num_dev);
-    }    
+        if (http_recv_body(req, buf, sizeof(buf)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (strcmp(req->uri, "/schedule") == 0) {
+            uint16_t new_job_id;
+            err = scheduler_add_job(buf, &new_job_id);
+            job_id = new_job_id;
+        } else {
+            err = scheduler_update_job(job_id, buf);
+        }
+    }
+
+    if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        httpd_resp_sendstr(req, "Time not synced");
+        return ESP_OK;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_OK;
+    }
+    snprintf(buf, sizeof(buf), "{\"id\":%ld}", job_id);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, buf);
+    return ESP_OK;
+}
+
+// GET /api/device/{id}/keys, POST /api/device/{id}/key/{NAME} or /api/device/{id}/learn/{NAME}
+static esp_err_t http_resp_api_device(httpd_req_t *req)
+{
+    if (get_wifi_mode() != WIFI_MODE_STA) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    if (http_admit(req, req->method == HTTP_GET ? RATE_LIMIT_CLASS_API : RATE_LIMIT_CLASS_IR) != ESP_OK)
+        return ESP_OK;
+
+    char *pch;
+    long num_dev = strtol(req->uri + strlen("/api/device/"), &pch, 10) - 1;
+    if (num_dev < 0 || num_dev >= IR_TV_NUM_REMOTE || *pch != '/') {
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+    pch++;
+
+    if (req->method == HTTP_GET) {
+        if (strcmp(pch, "keys") != 0) {
+            httpd_resp_send_404(req);
+            return ESP_OK;
+        }
+        char buf[160];
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr_chunk(req, "[");
+        for (int i = 0; i < IR_TV_NUM_CODE; i++) {
+            const ir_key_view_t *view = ir_key_get_view(i);
+            snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"code\":%d,\"learned\":%s,\"label\":\"%s\",\"style\":\"%s\",\"grid\":\"%s\"}",
+                    i ? "," : "", ir_key_get_name(i), i, ir_is_learned_tv(i, num_dev) ? "true" : "false", view->label, view->style, view->grid);
+            httpd_resp_sendstr_chunk(req, buf);
+        }
+        httpd_resp_sendstr_chunk(req, "]");
+        httpd_resp_sendstr_chunk(req, NULL);
+        return ESP_OK;
+    }
+
+    uint8_t is_learn = 0;
+    if (strncmp(pch, "key/", strlen("key/")) == 0) {
+        pch += strlen("key/");
+    } else if (strncmp(pch, "learn/", strlen("learn/")) == 0) {
+        pch += strlen("learn/");
+        is_learn = 1;
+    } else {
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+    int ir_code = ir_key_lookup(pch, strcspn(pch, "?"));
+    if (ir_code < 0) {
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+
+    esp_err_t err;
+    if (is_learn) {
+        err = ir_add_code_tv_detect(ir_code, num_dev);
+    } else {
+        err = ir_is_learned_tv(ir_code, num_dev) ? ir_send_code_tv_async(ir_code, num_dev, IR_TX_SOURCE_WEB, NULL, NULL) : ESP_ERR_NOT_FOUND;
+    }
+    if (err == ESP_ERR_NO_MEM) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+    } else if (err != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+    }
     httpd_resp_send(req, NULL, 0);
-    memset(buf, '\0', sizeof(buf));
+    return ESP_OK;
+}
+
+static esp_err_t http_resp_boot(httpd_req_t *req)
+{
+    if (http_admit(req, RATE_LIMIT_CLASS_API) != ESP_OK)
+        return ESP_OK;
+    char buf[224];
+    boot_stage_info_t info;
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf), "{\"done_us\":%lld,\"stages\":[", (long long) boot_get_done_us());
+    httpd_resp_sendstr_chunk(req, buf);
+    for (uint8_t i = 0; boot_get_stage(i, &info) == ESP_OK; i++) {
+        snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"core\":%d,\"ready_us\":%lld,\"start_us\":%lld,\"end_us\":%lld,\"critical\":%s,\"error\":\"%s\"}",
+                i ? "," : "", info.name, (int) info.core, (long long) info.ready_us, (long long) info.start_us,
+                (long long) info.end_us, info.is_critical ? "true" : "false", info.err == ESP_OK ? "" : esp_err_to_name(info.err));
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_sendstr_chunk(req, NULL);
+    return ESP_OK;
+}
+
+static esp_err_t http_resp_ratelimit(httpd_req_t *req)
+{
+    if (http_admit(req, RATE_LIMIT_CLASS_API) != ESP_OK)
+        return ESP_OK;
+    char buf[128];
+    rate_limit_stats_t stats;
+    rate_limit_get_stats(&stats);
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf), "{\"clients\":%d,\"evictions\":%lu,\"ir_queue\":%d,\"ir_web_inflight\":%d,\"classes\":[",
+            stats.num_client, (unsigned long) stats.eviction, (int) ir_get_tx_queue_depth(), ir_get_tx_inflight(IR_TX_SOURCE_WEB));
+    httpd_resp_sendstr_chunk(req, buf);
+    for (int i = 0; i < RATE_LIMIT_NUM_CLASS; i++) {
+        snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"admitted\":%lu,\"throttled\":%lu,\"overloaded\":%lu}", i ? "," : "",
+                rate_limit_get_class_name(i), (unsigned long) stats.class_stats[i].admitted,
+                (unsigned long) stats.class_stats[i].throttled, (unsigned long) stats.class_stats[i].overloaded);
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_sendstr_chunk(req, NULL);
+    return ESP_OK;
+}
+
+static esp_err_t http_resp_mem(httpd_req_t *req)
+{
+    if (http_admit(req, RATE_LIMIT_CLASS_API) != ESP_OK)
+        return ESP_OK;
+    char buf[160];
+    mem_task_info_t task;
+    mem_heap_info_t heap;
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf), "{\"static\":%s,\"tasks\":[", MEM_STATIC_ALLOC ? "true" : "false");
+    httpd_resp_sendstr_chunk(req, buf);
+    for (int i = 0; mem_get_task(i, &task) == ESP_OK; i++) {
+        snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"stack\":%lu,\"min_free\":%lu,\"static\":%s}", i ? "," : "",
+                task.name, (unsigned long) task.stack_size, (unsigned long) task.stack_free_min, task.is_static ? "true" : "false");
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "],\"heaps\":[");
+    for (int i = 0; mem_get_heap(i, &heap) == ESP_OK; i++) {
+        snprintf(buf, sizeof(buf), "%s{\"caps\":\"%s\",\"total\":%u,\"free\":%u,\"min_free\":%u,\"largest\":%u,\"frag\":%d}",
+                i ? "," : "", heap.name, (unsigned) heap.total_bytes, (unsigned) heap.free_bytes, (unsigned) heap.min_free_bytes,
+                (unsigned) heap.largest_block, heap.fragmentation_pct);
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_sendstr_chunk(req, NULL);
     return ESP_OK;
 }
 
 static esp_err_t http_resp_ac_remote(httpd_req_t *req) 
 {   
+    if (http_admit(req, RATE_LIMIT_CLASS_PAGE) != ESP_OK)
+        return ESP_OK;
     char *pch =strrchr(req->uri,'/');
     long num_dev = strtol(pch + 1, NULL, 10);
     extern const unsigned char ac_remote_html_start[] asm("_binary_ac_remote_html_start");
@@ -151,6 +529,8 @@ static esp_err_t http_resp_ac_remote(httpd_req_t *req)
 
 static esp_err_t httpd_resp_setwifi(httpd_req_t *req)
 {
+    if (http_admit(req, RATE_LIMIT_CLASS_PAGE) != ESP_OK)
+        return ESP_OK;
     if (get_wifi_mode() != WIFI_MODE_AP) {
         httpd_resp_send_404(req);
         return ESP_FAIL;
@@ -165,19 +545,9 @@ static esp_err_t httpd_resp_setwifi(httpd_req_t *req)
     } else {
         static char buf_raw[128];
         static char buf_decode[128];
-        int ret, remaining = req->content_len;
-        while (remaining > 0)
-        {
-            if ((ret = httpd_req_recv(req, buf_raw, (remaining > sizeof(buf_raw) ? remaining : sizeof(buf_raw)))) <= 0) {
-                if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                    continue;
-                }
-                return ESP_FAIL;
-            }
-            remaining -= ret;
-        }
+        if (http_recv_body(req, buf_raw, sizeof(buf_raw)) != ESP_OK)
+            return ESP_FAIL;
 
-        buf_raw[req->content_len] = '\0';
         if (url_decode(buf_raw, buf_decode) != ESP_OK)
             return ESP_FAIL;
 
@@ -206,9 +576,12 @@ esp_err_t startwebserver(void)
 {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 10;
+    config.max_uri_handlers = 24;
     config.uri_match_fn = httpd_uri_match_wildcard;
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
+    if (rate_limit_init() != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
     
     if (httpd_start(&server, &config) != ESP_OK) {
         ESP_LOGE(TAG, "Error starting server");
@@ -277,6 +650,126 @@ esp_err_t startwebserver(void)
     };
     httpd_register_uri_handler(server, &add_tv);
 
+    httpd_uri_t sweep_tv = {
+        .uri = "/sweep/tv/*",
+        .method = HTTP_POST,
+        .handler = http_resp_tv_sweep,
+        .user_ctx = "start",
+    };
+    httpd_register_uri_handler(server, &sweep_tv);
+
+    httpd_uri_t sweep_confirm = {
+        .uri = "/sweep/confirm",
+        .method = HTTP_POST,
+        .handler = http_resp_tv_sweep,
+        .user_ctx = "confirm",
+    };
+    httpd_register_uri_handler(server, &sweep_confirm);
+
+    httpd_uri_t sweep_stop = {
+        .uri = "/sweep/stop",
+        .method = HTTP_POST,
+        .handler = http_resp_tv_sweep,
+        .user_ctx = "stop",
+    };
+    httpd_register_uri_handler(server, &sweep_stop);
+
+    httpd_uri_t backup_export = {
+        .uri = "/backup",
+        .method = HTTP_GET,
+        .handler = http_resp_backup,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &backup_export);
+
+    httpd_uri_t backup_import = {
+        .uri = "/backup",
+        .method = HTTP_POST,
+        .handler = http_resp_backup,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &backup_import);
+
+    httpd_uri_t sync_manifest = {
+        .uri = "/sync/manifest",
+        .method = HTTP_GET,
+        .handler = http_resp_sync_manifest,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &sync_manifest);
+
+    httpd_uri_t schedule_list = {
+        .uri = "/schedule",
+        .method = HTTP_GET,
+        .handler = http_resp_schedule,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &schedule_list);
+
+    httpd_uri_t schedule_add = {
+        .uri = "/schedule",
+        .method = HTTP_POST,
+        .handler = http_resp_schedule,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &schedule_add);
+
+    httpd_uri_t schedule_update = {
+        .uri = "/schedule/*",
+        .method = HTTP_POST,
+        .handler = http_resp_schedule,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &schedule_update);
+
+    httpd_uri_t schedule_delete = {
+        .uri = "/schedule/*",
+        .method = HTTP_DELETE,
+        .handler = http_resp_schedule,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &schedule_delete);
+
+    httpd_uri_t api_device_get = {
+        .uri = "/api/device/*",
+        .method = HTTP_GET,
+        .handler = http_resp_api_device,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &api_device_get);
+
+    httpd_uri_t api_device_post = {
+        .uri = "/api/device/*",
+        .method = HTTP_POST,
+        .handler = http_resp_api_device,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &api_device_post);
+
+    httpd_uri_t boot_report = {
+        .uri = "/boot",
+        .method = HTTP_GET,
+        .handler = http_resp_boot,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &boot_report);
+
+    httpd_uri_t ratelimit_report = {
+        .uri = "/ratelimit",
+        .method = HTTP_GET,
+        .handler = http_resp_ratelimit,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &ratelimit_report);
+
+    httpd_uri_t mem_report = {
+        .uri = "/mem",
+        .method = HTTP_GET,
+        .handler = http_resp_mem,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &mem_report);
+
     httpd_uri_t set_wifi_page = {
         .uri = "/wifi",
         .method = HTTP_GET,
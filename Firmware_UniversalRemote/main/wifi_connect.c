@@ -6,6 +6,7 @@
 #include "sys/param.h"
 #include "esp_netif.h"
 #include "mdns.h"
+#include "mem_budget.h"
 
 static const char *TAG = "WIFI";
 static const char *TAG_STA = "WIFI Sta";
@@ -13,6 +14,7 @@ static const char *TAG_AP = "WIFI Ap";
 
 ESP_EVENT_DEFINE_BASE(USER_EVENTS);
 static EventGroupHandle_t s_wifi_event_group;
+MEM_EVENT_GROUP_BUFFER(s_wifi_event_group);
 static const int S_CONNECTED_BIT = BIT0;
 
 static nvs_handle_t s_wifi_nvs_handle;
@@ -141,7 +143,7 @@ static void wifi_event_handle(void *arg, esp_event_base_t event_base,
 
 esp_err_t wifi_init(void) 
 {
-  s_wifi_event_group = xEventGroupCreate();
+  s_wifi_event_group = mem_event_group_create(MEM_EVENT_GROUP(s_wifi_event_group));
   ESP_ERROR_CHECK(esp_netif_init());
   ESP_ERROR_CHECK(esp_event_loop_create_default());
 